@@ -0,0 +1,134 @@
+/*
+ * Compares the generic and the bulk vertex packing paths used by BezierCrop
+ * when uploading its tessellated geometry, for shapes of 10 to 100k segments
+ *
+ * How to run:
+ * cmake -DZUAZO_COMPOSITOR_BUILD_BENCHMARKS=ON ... && ./bezier_crop_packing
+ */
+
+#include <Layers/BezierCropVertex.h>
+
+#include <vector>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+
+using namespace Zuazo;
+
+//Same layout as the vertices produced by OutlineProcessor
+struct OutlineVertex {
+	Math::Vec2f pos;
+	Math::Vec3f klm;
+};
+
+static_assert(Layers::isBezierCropPackable<OutlineVertex>(), "Benchmark would not use the bulk path");
+
+//The curve triangles of a cubic segment use its 4 control points
+static constexpr size_t VERTICES_PER_SEGMENT = 4;
+
+static std::vector<OutlineVertex> createVertices(size_t segmentCount) {
+	std::vector<OutlineVertex> result(segmentCount * VERTICES_PER_SEGMENT);
+
+	for(size_t i = 0; i < result.size(); ++i) {
+		const auto x = static_cast<float>(i);
+		result[i].pos.x = std::cos(x);
+		result[i].pos.y = std::sin(x);
+		result[i].klm.x = x;
+		result[i].klm.y = x*x;
+		result[i].klm.z = x*x*x;
+	}
+
+	return result;
+}
+
+template<typename F>
+static double measure(F&& func, size_t vertexCount) {
+	//Repeat small shapes so that every run packs ~16M vertices. The best
+	//of several runs is reported to filter out scheduling noise
+	constexpr size_t WARMUP_ITERATIONS = 16;
+	constexpr size_t RUN_COUNT = 7;
+	constexpr size_t TOTAL_VERTEX_COUNT = 1 << 24;
+	const size_t iterations = std::max<size_t>(TOTAL_VERTEX_COUNT / vertexCount, 16);
+
+	for(size_t i = 0; i < WARMUP_ITERATIONS; ++i) {
+		func();
+	}
+
+	auto result = std::numeric_limits<double>::infinity();
+	for(size_t i = 0; i < RUN_COUNT; ++i) {
+		const auto begin = std::chrono::steady_clock::now();
+		for(size_t j = 0; j < iterations; ++j) {
+			func();
+		}
+		const auto end = std::chrono::steady_clock::now();
+
+		const std::chrono::duration<double, std::nano> elapsed = end - begin;
+		result = std::min(result, elapsed.count() / (iterations * vertexCount));
+	}
+
+	return result;
+}
+
+template<typename F>
+static bool check(F&& func, const std::vector<Layers::BezierCropVertex>& expected) {
+	//Start from a poisoned buffer so that untouched floats are detected
+	std::vector<Layers::BezierCropVertex> result(expected.size(), Layers::BezierCropVertex(Math::Vec2f(NAN)));
+	func(reinterpret_cast<float*>(result.data()));
+	return std::memcmp(result.data(), expected.data(), sizeof(Layers::BezierCropVertex)*expected.size()) == 0;
+}
+
+
+
+int main() {
+	constexpr std::array SEGMENT_COUNTS = { 10, 100, 1000, 10000, 100000 };
+
+	std::printf("%10s %10s %10s %10s %10s %10s %10s\n", "Segments", "Vertices", "Generic", "Scalar", "SSE2", "AVX2", "Selected");
+
+	for(const size_t segmentCount : SEGMENT_COUNTS) {
+		const auto source = createVertices(segmentCount);
+		const auto target = createVertices(segmentCount);
+		const auto count = source.size();
+		std::vector<Layers::BezierCropVertex> destination(count, Layers::BezierCropVertex(Math::Vec2f(0)));
+
+		auto* d = reinterpret_cast<float*>(destination.data());
+		const auto* s = reinterpret_cast<const float*>(source.data());
+		const auto* t = reinterpret_cast<const float*>(target.data());
+
+		//Validate the kernels against the generic path before timing them
+		std::vector<Layers::BezierCropVertex> expected(count, Layers::BezierCropVertex(Math::Vec2f(0)));
+		Layers::packBezierCropVerticesGeneric(expected.data(), source.data(), target.data(), count);
+		bool valid = check([&] (float* r) { Layers::packBezierCropChunksScalar(r, s, t, count); }, expected);
+	#if defined(ZUAZO_BEZIER_CROP_VERTEX_X86)
+		valid &= check([&] (float* r) { Layers::packBezierCropChunksSse2(r, s, t, count); }, expected);
+		if(__builtin_cpu_supports("avx2")) {
+			valid &= check([&] (float* r) { Layers::packBezierCropChunksAvx2(r, s, t, count); }, expected);
+		}
+	#endif
+		if(!valid) {
+			std::fprintf(stderr, "Packing kernels do not match the generic path\n");
+			return 1;
+		}
+
+		const auto generic = measure([&] { Layers::packBezierCropVerticesGeneric(destination.data(), source.data(), target.data(), count); }, count);
+		const auto scalar = measure([&] { Layers::packBezierCropChunksScalar(d, s, t, count); }, count);
+	#if defined(ZUAZO_BEZIER_CROP_VERTEX_X86)
+		const auto sse2 = measure([&] { Layers::packBezierCropChunksSse2(d, s, t, count); }, count);
+		const auto avx2 = 	__builtin_cpu_supports("avx2") ?
+							measure([&] { Layers::packBezierCropChunksAvx2(d, s, t, count); }, count) :
+							NAN ;
+	#else
+		const auto sse2 = NAN;
+		const auto avx2 = NAN;
+	#endif
+		const auto selected = measure([&] { Layers::packBezierCropVertices(destination.data(), source.data(), target.data(), count); }, count);
+
+		std::printf("%10zu %10zu %10.3f %10.3f %10.3f %10.3f %10.3f\n", segmentCount, count, generic, scalar, sse2, avx2, selected);
+	}
+
+	std::printf("Times in ns/vertex\n");
+	return 0;
+}
\ No newline at end of file
@@ -2,12 +2,14 @@
 
 #include <zuazo/ZuazoBase.h>
 #include <zuazo/Video.h>
+#include <zuazo/VideoMode.h>
 #include <zuazo/LayerBase.h>
 #include <zuazo/Signal/ConsumerLayout.h>
 #include <zuazo/Utils/Pimpl.h>
 #include <zuazo/Math/BezierLoop.h>
 
 #include <functional>
+#include <vector>
 
 namespace Zuazo::Layers {
 
@@ -23,6 +25,11 @@ class BezierCrop
 public:
 	using BezierLoop = Math::BezierLoop<Math::Vec2f, 3>;
 
+	enum class RenderingMode {
+		tessellated,	//Loop-Blinn tessellation. Anti-aliased, supports borders
+		stencilCover,	//Stencil then cover. No CPU tessellation, requires a stencil buffer
+	};
+
 	BezierCrop(	Instance& instance,
 				std::string name,
 				Math::Vec2f size,
@@ -37,9 +44,22 @@ public:
 	void									setSize(Math::Vec2f size);
 	Math::Vec2f								getSize() const;
 
+	const Video&							getLastFrame() const; //Last frame received from the input
+
+	void									setRenderingMode(RenderingMode mode);
+	RenderingMode							getRenderingMode() const;
+
 	void									setCrop(Utils::BufferView<const BezierLoop> crop);
 	Utils::BufferView<const BezierLoop>		getCrop() const;
 
+	bool									setMorphTarget(Utils::BufferView<const BezierLoop> target); //False if the crop can not be morphed into it
+	Utils::BufferView<const BezierLoop>		getMorphTarget() const;
+	bool									isMorphable() const;
+	const Math::Vec4f&						getBoundaries() const; //Local space {min.x, min.y, max.x, max.y} of the crop and the morph target
+
+	void									setMorphFactor(float factor);
+	float									getMorphFactor() const;
+
 	void									setLineColor(const Math::Vec4f& color);
 	const Math::Vec4f&						getLineColor() const;
 
@@ -49,6 +69,10 @@ public:
 	void									setLineSmoothness(float smoothness);
 	float									getLineSmoothness() const;
 
+	bool									isInside(Math::Vec2f point) const;
+
+	std::vector<VideoMode>					getPreferredVideoModes() const; //Ordered by preference. Avoids conversions upstream
+
 };
 
 }
\ No newline at end of file
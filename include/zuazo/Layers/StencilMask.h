@@ -0,0 +1,56 @@
+#pragma once
+
+#include <zuazo/ZuazoBase.h>
+#include <zuazo/LayerBase.h>
+#include <zuazo/DepthStencilFormat.h>
+#include <zuazo/Utils/Pimpl.h>
+#include <zuazo/Math/BezierLoop.h>
+
+#include <functional>
+
+namespace Zuazo::Layers {
+
+struct StencilMaskImpl;
+class StencilMask
+	: private Utils::Pimpl<StencilMaskImpl>
+	, public ZuazoBase
+	, public LayerBase
+{
+	friend StencilMaskImpl;
+public:
+	using BezierLoop = Math::BezierLoop<Math::Vec2f, 3>;
+
+	//The most significant stencil bit flags the pixels outside the mask. The
+	//rest of the bits are available for layers to accumulate winding numbers
+	static constexpr uint32_t STENCIL_MASK_BIT = 0x80;
+	static constexpr uint32_t STENCIL_WINDING_BITS = STENCIL_MASK_BIT - 1;
+
+	StencilMask(Instance& instance,
+				std::string name,
+				Utils::BufferView<const BezierLoop> crop );
+	StencilMask(const StencilMask& other) = delete;
+	StencilMask(StencilMask&& other);
+	virtual ~StencilMask();
+
+	StencilMask&							operator=(const StencilMask& other) = delete;
+	StencilMask&							operator=(StencilMask&& other);
+
+	void									setCrop(Utils::BufferView<const BezierLoop> crop);
+	Utils::BufferView<const BezierLoop>		getCrop() const;
+
+	//Layers placed between the mask and its end layer are clipped. Both
+	//need to be drawn by the same renderer. Masks do not nest: the ones 
+	//placed inside the range of another mask are not drawn, neither are 
+	//their end layers. The winding bits are zero all along the range, so
+	//layers may use them as long as they leave them zeroed, as BezierCrop
+	//does when rendering in stencil and cover mode
+	LayerBase&								getEndLayer();
+	const LayerBase&						getEndLayer() const;
+	static bool								isEndLayer(const LayerBase& layer) noexcept;
+
+	static vk::StencilOpState				getStencilTestConfiguration() noexcept;
+	static bool								hasStencilComponent(DepthStencilFormat format) noexcept;
+
+};
+
+}
\ No newline at end of file
@@ -2,11 +2,15 @@
 
 #include <zuazo/ZuazoBase.h>
 #include <zuazo/Video.h>
+#include <zuazo/VideoMode.h>
 #include <zuazo/LayerBase.h>
 #include <zuazo/Signal/ConsumerLayout.h>
 #include <zuazo/Utils/Pimpl.h>
+#include <zuazo/Chrono.h>
+#include <zuazo/Resolution.h>
 
 #include <functional>
+#include <vector>
 
 namespace Zuazo::Layers {
 
@@ -20,6 +24,31 @@ class VideoSurface
 {
 	friend VideoSurfaceImpl;
 public:
+	//Animation state relative to the transform and opacity of the layer.
+	//Evaluated on the GPU. Keyframes must be sorted by time
+	struct Keyframe {
+		Duration								time;
+		Math::Vec3f								position = Math::Vec3f(0.0f);
+		Math::Vec2f								scale = Math::Vec2f(1.0f);
+		float									rotation = 0.0f; //Radians around Z
+		float									opacity = 1.0f;
+		Math::Vec4f								easing = Math::Vec4f(0.0f, 0.0f, 1.0f, 1.0f); //Cubic bezier towards the next keyframe
+	};
+
+	static constexpr size_t MAX_KEYFRAME_COUNT = 16;
+
+	//Analytic shape used to crop the surface. Edges are anti-aliased
+	enum class Shape {
+		rectangle,
+		roundedRectangle,
+		ellipse,
+	};
+
+	//Called when the size at which the surface is displayed changes 
+	//significantly, so that the source can deliver a matching resolution.
+	//Invoked from the rendering thread, with the instance locked
+	using ProjectedSizeCallback = std::function<void(VideoSurface&, Resolution)>;
+
 	VideoSurface(	Instance& instance,
 					std::string name,
 					Math::Vec2f size );
@@ -33,6 +62,31 @@ public:
 	void									setSize(Math::Vec2f size);
 	Math::Vec2f								getSize() const;
 
+	const Video&							getLastFrame() const; //Last frame received from the input
+
+	void									setAnimation(	Utils::BufferView<const Keyframe> keyframes,
+															TimePoint startTime,
+															bool loop = false );
+	Utils::BufferView<const Keyframe>		getAnimation() const;
+	TimePoint								getAnimationStartTime() const;
+	bool									getAnimationLoop() const;
+	Math::Mat4x4f							calculateAnimationMatrix() const; //Current animation state. Identity if not animated
+
+	void									setShape(Shape shape);
+	Shape									getShape() const;
+
+	void									setCornerRadius(float radius); //Only used with Shape::roundedRectangle
+	float									getCornerRadius() const;
+
+	bool									isOpaque() const; //True if it fully covers its size with opaque pixels. False while a new frame is pending
+
+	void									setProjectedSizeCallback(ProjectedSizeCallback cbk);
+	const ProjectedSizeCallback&			getProjectedSizeCallback() const;
+	Resolution								getProjectedSize() const; //Last notified size. Zero if not displayed
+	void									clearProjectedSize(const RendererBase& renderer); //Not displayed by the renderer, i.e. culled
+
+	std::vector<VideoMode>					getPreferredVideoModes() const; //Ordered by preference. Avoids conversions upstream
+
 };
 
 }
\ No newline at end of file
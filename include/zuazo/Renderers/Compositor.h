@@ -8,6 +8,19 @@
 #include <zuazo/Utils/Pimpl.h>
 #include <zuazo/Signal/SourceLayout.h>
 #include <zuazo/Math/Transform.h>
+#include <zuazo/Chrono.h>
+#include <zuazo/ScalingFilter.h>
+
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+namespace Zuazo::Layers {
+
+class VideoSurface;
+class BezierCrop;
+
+}
 
 namespace Zuazo::Renderers {
 
@@ -21,6 +34,50 @@ class Compositor
 {
 	friend CompositorImpl;
 public:
+	//Dynamic resolution statistics
+	struct GovernorStatistics {
+		float								renderScale;		//Fraction of the output resolution used for rendering
+		bool								reducedFiltering;	//Layers use linear instead of cubic filtering
+		Duration							averageFrameTime;
+		size_t								downscaleCount;
+		size_t								upscaleCount;
+	};
+
+	//Output format chosen according to the inputs
+	struct FormatRecommendation {
+		ColorFormat							format;
+		ColorTransferFunction				colorTransferFunction;
+		std::string_view					reason;
+	};
+
+	//Set of layer property changes applied at once on the next frame. 
+	//Layers must outlive the commit of the transaction
+	class Transaction {
+		friend CompositorImpl;
+	public:
+		void								setTransform(LayerBase& layer, const Math::Transformf& transform);
+		void								setOpacity(LayerBase& layer, float opacity);
+		void								setSize(Layers::VideoSurface& layer, Math::Vec2f size);
+		void								setSize(Layers::BezierCrop& layer, Math::Vec2f size);
+
+		void								merge(Transaction other);
+		bool								empty() const noexcept;
+		void								clear() noexcept;
+
+	private:
+		using SizeSetter = void(*)(LayerBase&, Math::Vec2f);
+
+		struct Changes {
+			std::optional<Math::Transformf>		transform;
+			std::optional<float>				opacity;
+			std::optional<Math::Vec2f>			size;
+			SizeSetter							sizeSetter = nullptr;
+		};
+
+		std::unordered_map<LayerBase*, Changes> changes;
+
+	};
+
 	Compositor(	Instance& instance, 
 				std::string name );
 	Compositor(const Compositor& other) = delete;
@@ -30,6 +87,34 @@ public:
 	Compositor& 							operator=(const Compositor& other) = delete;
 	Compositor& 							operator=(Compositor&& other);
 
+	//Stable identifiers for layers inserted incrementally. While open, 
+	//the changes are published once at the next frame, and only if there
+	//are any. Calling setLayers() directly invalidates all of them and 
+	//wins over the unpublished edits made before it
+	using LayerHandle = uint64_t;
+	static constexpr LayerHandle NO_LAYER = 0;
+
+	LayerHandle								insertLayer(LayerBase& layer, LayerHandle before = NO_LAYER);
+	void									removeLayer(LayerHandle handle);
+	void									moveLayer(LayerHandle handle, LayerHandle before = NO_LAYER);
+	LayerBase*								getLayer(LayerHandle handle) const;
+
+	//Obtains the topmost layer at the given position, in pixels from the 
+	//top left corner of the viewport. nullptr if none
+	LayerBase*								pick(Math::Vec2f position);
+
+	void									commit(Transaction transaction);
+	void									post(Transaction transaction); //Thread safe. Instance lock is not needed
+
+	void									setFrameTimeBudget(Duration budget); //Zero disables dynamic resolution
+	Duration								getFrameTimeBudget() const;
+	GovernorStatistics						getGovernorStatistics() const;
+	static ScalingFilter					limitScalingFilter(const RendererBase& renderer, ScalingFilter filter) noexcept; //Filter to be used by layers drawn by the renderer
+
+	void									setAutomaticFormat(bool ena); //Restricts the negotiation to the recommended format
+	bool									getAutomaticFormat() const;
+	FormatRecommendation					getFormatRecommendation() const;
+
 };
 
 }
\ No newline at end of file
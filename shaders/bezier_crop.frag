@@ -4,7 +4,6 @@
 
 #include "frame.glsl"
 #include "bezier.glsl"
-#include "border.glsl"
 
 //Constants
 layout (constant_id = 0) const int SAMPLE_MODE = frame_SAMPLE_MODE_PASSTHOUGH;
@@ -29,17 +28,23 @@ frame_descriptor_set(2)
 
 
 void main() {
-	//Obtain th signed distance to the curve
+	//Obtain th signed distance to the curve. Negative values lay inside
 	const float sDist = bezier3_signed_distance(in_klm);
-	if(sDist > 0) {
+
+	//Analytic coverage of the edge. Pixels half a pixel away from the curve
+	//are considered to be fully inside or outside
+	const float coverage = clamp(0.5 - sDist, 0.0, 1.0);
+	if(coverage <= 0.0) {
 		discard;
 	}
 
 	//Sample the color from the frame
 	vec4 color = frame_texture(SAMPLE_MODE, frame_sampler(2), in_texCoord);
 
+	//Border is stroked by the edge pass
+
 	//Apply the opacity and bezier alpha to it
-	color.a *= opacity;
+	color.a *= opacity * coverage;
 
 	//Premultiply alpha for outputing
 	out_color = frame_premultiply_alpha(color);
@@ -2,8 +2,9 @@
 
 //Vertex I/O
 layout(location = 0) in vec4 in_position;
-layout(location = 1) in vec2 in_texCoord;
-layout(location = 2) in vec3 in_klm;
+layout(location = 1) in vec3 in_klm;
+layout(location = 2) in vec4 in_morphPosition;
+layout(location = 3) in vec3 in_morphKlm;
 
 layout(location = 0) out vec2 out_texCoord;
 layout(location = 1) out vec3 out_klm;
@@ -13,13 +14,18 @@ layout(set = 0, binding = 0) uniform ProjectionBlock {
 	mat4 projectionMtx;
 };
 
-layout(set = 1, binding = 0) uniform ModelBlock {
+layout(set = 1, binding = 0) uniform VertexDataBlock {
 	mat4 modelMtx;
+	float morphFactor;
+	vec2 texCoordScale;
 };
 
 
 void main() {
-    gl_Position = projectionMtx * modelMtx * in_position;
-	out_texCoord = in_texCoord;
-	out_klm = in_klm;
+	//Interpolate between the source and the target shapes
+	const vec4 position = mix(in_position, in_morphPosition, morphFactor);
+
+    gl_Position = projectionMtx * modelMtx * position;
+	out_texCoord = vec2(0.5) + position.xy * texCoordScale;
+	out_klm = mix(in_klm, in_morphKlm, morphFactor);
 }
\ No newline at end of file
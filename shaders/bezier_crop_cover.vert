@@ -0,0 +1,26 @@
+#version 450
+
+//Vertex I/O
+layout(location = 0) out vec2 out_texCoord;
+
+//Uniform buffers
+layout(set = 0, binding = 0) uniform ProjectionBlock {
+	mat4 projectionMtx;
+};
+
+layout(set = 1, binding = 0) uniform VertexDataBlock {
+	mat4 modelMtx;
+	float morphFactor;
+	vec2 texCoordScale;
+	vec4 coverBounds;
+};
+
+
+void main() {
+	//Generate a quad enclosing the shape's control points
+	const vec2 corner = vec2(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1);
+	const vec4 position = vec4(mix(coverBounds.xy, coverBounds.zw, corner), 0.0, 1.0);
+
+    gl_Position = projectionMtx * modelMtx * position;
+	out_texCoord = vec2(0.5) + position.xy * texCoordScale;
+}
\ No newline at end of file
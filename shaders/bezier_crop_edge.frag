@@ -0,0 +1,69 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#include "frame.glsl"
+
+//Constants
+layout (constant_id = 0) const int SAMPLE_MODE = frame_SAMPLE_MODE_PASSTHOUGH;
+
+//Vertex I/O
+layout(location = 0) in vec2 in_texCoord;
+layout(location = 1) in float in_distance;
+layout(location = 2) flat in float in_fringe;
+
+layout(location = 0) out vec4 out_color;
+
+//Uniform buffers
+layout(set = 1, binding = 1) uniform LayerDataBlock {
+	vec4 lineColor;
+	float lineWidth;
+	float lineSmoothness;
+	float opacity;
+};
+
+//Frame descriptor set
+frame_descriptor_set(2)
+
+
+
+void main() {
+	//Stroke the border along the inner side of the edge. Distance is 
+	//expressed in pixels and it is negative inside
+	float lineAlpha = 0.0;
+	if(lineWidth > 0.0) {
+		const float halfSmoothness = lineSmoothness / 2.0;
+		lineAlpha = lineColor.a * (1.0 - smoothstep(
+			lineWidth - halfSmoothness, 
+			lineWidth + halfSmoothness, 
+			-in_distance
+		));
+	}
+
+	vec4 color = vec4(lineColor.rgb, lineAlpha);
+	if(in_distance >= 0.0) {
+		//Analytic coverage of the edge. Pixels half a pixel away from the 
+		//edge are considered to be fully inside or outside
+		const float coverage = clamp(0.5 - in_distance, 0.0, 1.0);
+
+		if(in_fringe != 0.0) {
+			//The fill has a hard edge here. Blend the line over the frame
+			const vec4 frameColor = frame_texture(SAMPLE_MODE, frame_sampler(2), in_texCoord);
+			const float alpha = lineAlpha + frameColor.a*(1.0 - lineAlpha);
+			color.rgb = alpha > 0.0 ? (lineColor.rgb*lineAlpha + frameColor.rgb*frameColor.a*(1.0 - lineAlpha)) / alpha : vec3(0.0);
+			color.a = alpha;
+		}
+
+		color.a *= coverage;
+	} //Otherwise the frame has already been drawn by the fill
+
+	//Apply the opacity to it
+	color.a *= opacity;
+	if(color.a <= 0.0) {
+		discard;
+	}
+
+	//Premultiply alpha for outputing
+	out_color = frame_premultiply_alpha(color);
+}
+ 
\ No newline at end of file
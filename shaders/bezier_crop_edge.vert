@@ -0,0 +1,111 @@
+#version 450
+
+//Vertex I/O. One instance per cubic segment
+layout(location = 0) in vec2 in_points[4];
+layout(location = 4) in vec2 in_morphPoints[4];
+
+layout(location = 0) out vec2 out_texCoord;
+layout(location = 1) out float out_distance;
+layout(location = 2) flat out float out_fringe;
+
+//Uniform buffers
+layout(set = 0, binding = 0) uniform ProjectionBlock {
+	mat4 projectionMtx;
+};
+
+layout(set = 1, binding = 0) uniform VertexDataBlock {
+	mat4 modelMtx;
+	float morphFactor;
+	vec2 texCoordScale;
+	vec4 coverBounds;
+	float fillSide;
+};
+
+layout(set = 1, binding = 1) uniform LayerDataBlock {
+	vec4 lineColor;
+	float lineWidth;
+	float lineSmoothness;
+	float opacity;
+};
+
+layout(push_constant) uniform EdgeBlock {
+	uint subdivisions;
+	uint fringeCurves;
+	vec2 viewportSize;
+};
+
+//Width of the antialiasing fringe, in pixels
+const float FRINGE_WIDTH = 1.0;
+const float STRAIGHT_EPSILON = 1e-4;
+
+
+vec2 evaluate_cubic(in vec2 p0, in vec2 p1, in vec2 p2, in vec2 p3, in float t) {
+	const float s = 1.0 - t;
+	return s*s*s*p0 + 3.0*s*s*t*p1 + 3.0*s*t*t*p2 + t*t*t*p3;
+}
+
+vec2 evaluate_cubic_derivative(in vec2 p0, in vec2 p1, in vec2 p2, in vec2 p3, in float t) {
+	const float s = 1.0 - t;
+	return 3.0*s*s*(p1 - p0) + 6.0*s*t*(p2 - p1) + 3.0*t*t*(p3 - p2);
+}
+
+float cross2(in vec2 a, in vec2 b) {
+	return a.x*b.y - a.y*b.x;
+}
+
+vec2 project_direction(in mat4 mvp, in vec4 clipPosition, in vec2 direction) {
+	//Derivative of the perspective division, scaled to pixels
+	const vec4 clipDirection = mvp * vec4(direction, 0.0, 0.0);
+	const vec2 ndcDirection = (clipDirection.xy*clipPosition.w - clipPosition.xy*clipDirection.w) / (clipPosition.w*clipPosition.w);
+	return ndcDirection * viewportSize / 2.0;
+}
+
+void main() {
+	//Each segment is drawn as a strip along its flattened curve. Even 
+	//vertices lay on the inner side and odd ones on the outer side
+	const uint index = uint(gl_VertexIndex) / 2;
+	const bool outer = (gl_VertexIndex % 2) != 0;
+	const float t = float(index) / float(subdivisions);
+
+	//Interpolate between the source and the target shapes
+	const vec2 p0 = mix(in_points[0], in_morphPoints[0], morphFactor);
+	const vec2 p1 = mix(in_points[1], in_morphPoints[1], morphFactor);
+	const vec2 p2 = mix(in_points[2], in_morphPoints[2], morphFactor);
+	const vec2 p3 = mix(in_points[3], in_morphPoints[3], morphFactor);
+
+	const vec2 position = evaluate_cubic(p0, p1, p2, p3, t);
+	vec2 tangent = evaluate_cubic_derivative(p0, p1, p2, p3, t);
+	if(dot(tangent, tangent) == 0.0) {
+		tangent = p3 - p0; //Repeated control points at the ends
+	}
+
+	//Normal pointing away from the filled area
+	const vec2 normal = fillSide * normalize(vec2(tangent.y, -tangent.x));
+
+	//Extrude in screen space, so that the widths are expressed in pixels.
+	//Mirroring transforms are taken into account by projecting the normal
+	const mat4 mvp = projectionMtx * modelMtx;
+	const vec4 clipPosition = mvp * vec4(position, 0.0, 1.0);
+	const vec2 projectedTangent = project_direction(mvp, clipPosition, tangent);
+	const vec2 projectedNormal = project_direction(mvp, clipPosition, normal);
+	vec2 pixelNormal = normalize(vec2(projectedTangent.y, -projectedTangent.x));
+	if(dot(pixelNormal, projectedNormal) < 0.0) {
+		pixelNormal = -pixelNormal;
+	}
+
+	//The line lays on the inner side, the fringe on the outer side
+	const float innerWidth = lineWidth > 0.0 ? lineWidth + lineSmoothness / 2.0 + FRINGE_WIDTH : 0.0;
+	const float distance = outer ? FRINGE_WIDTH : -innerWidth;
+	const vec2 pixelOffset = pixelNormal * distance;
+	const vec2 modelOffset = normal * distance / max(length(projectedNormal), 1e-6);
+
+	gl_Position = clipPosition + vec4(pixelOffset * 2.0 / viewportSize * clipPosition.w, 0.0, 0.0);
+	out_texCoord = vec2(0.5) + (position + modelOffset) * texCoordScale;
+	out_distance = distance;
+
+	//Curves are already antialiased by the fill when tessellated
+	const vec2 chord = p3 - p0;
+	const float tolerance = STRAIGHT_EPSILON * dot(chord, chord);
+	const bool straight = abs(cross2(p1 - p0, chord)) <= tolerance && abs(cross2(p2 - p0, chord)) <= tolerance;
+	out_fringe = (fringeCurves != 0 || straight) ? 1.0 : 0.0;
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#version 450
+
+//Vertex I/O. One instance per cubic segment
+layout(location = 0) in vec2 in_points[4];
+layout(location = 4) in vec2 in_morphPoints[4];
+
+//Uniform buffers
+layout(set = 0, binding = 0) uniform ProjectionBlock {
+	mat4 projectionMtx;
+};
+
+layout(set = 1, binding = 0) uniform VertexDataBlock {
+	mat4 modelMtx;
+	float morphFactor;
+	vec2 texCoordScale;
+	vec4 coverBounds;
+};
+
+//Amount of triangles per segment, chosen according to its size on screen
+layout(push_constant) uniform StencilBlock {
+	uint subdivisions;
+};
+
+
+vec2 evaluate_cubic(in vec2 p0, in vec2 p1, in vec2 p2, in vec2 p3, in float t) {
+	const float s = 1.0 - t;
+	return s*s*s*p0 + 3.0*s*s*t*p1 + 3.0*s*t*t*p2 + t*t*t*p3;
+}
+
+void main() {
+	//Each segment is drawn as a fan of triangles from the origin. Their
+	//signed areas add up to the winding number on the stencil
+	const uint triangle = uint(gl_VertexIndex) / 3;
+	const uint corner = uint(gl_VertexIndex) % 3;
+
+	vec2 position = vec2(0.0);
+	if(corner != 0) {
+		const float t = float(triangle + corner - 1) / float(subdivisions);
+		
+		//Interpolate between the source and the target shapes
+		const vec2 p0 = mix(in_points[0], in_morphPoints[0], morphFactor);
+		const vec2 p1 = mix(in_points[1], in_morphPoints[1], morphFactor);
+		const vec2 p2 = mix(in_points[2], in_morphPoints[2], morphFactor);
+		const vec2 p3 = mix(in_points[3], in_morphPoints[3], morphFactor);
+
+		position = evaluate_cubic(p0, p1, p2, p3, t);
+	}
+
+    gl_Position = projectionMtx * modelMtx * vec4(position, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#include "frame.glsl"
+
+//Constants
+layout (constant_id = 0) const int SAMPLE_MODE = frame_SAMPLE_MODE_PASSTHOUGH;
+
+//Vertex I/O
+layout(location = 0) in vec2 in_texCoord;
+
+layout(location = 0) out vec4 out_color;
+
+//Frame descriptor set
+frame_descriptor_set(0)
+
+void main() {
+	//Sample the color from the reduced resolution frame. Same as a
+	//stretched VideoSurface with write blending
+	const vec4 color = frame_texture(SAMPLE_MODE, frame_sampler(0), in_texCoord);
+
+	//Premultiply alpha for outputing
+	out_color = frame_premultiply_alpha(color);
+}
+ 
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 450
+
+//Vertex I/O
+layout(location = 0) out vec2 out_texCoord;
+
+void main() {
+	//Generate a quad covering the whole viewport
+	const vec2 corner = vec2(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1);
+	gl_Position = vec4(2.0*corner - vec2(1.0), 0.0, 1.0);
+	out_texCoord = corner;
+}
\ No newline at end of file
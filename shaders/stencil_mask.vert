@@ -0,0 +1,7 @@
+#version 450
+
+void main() {
+	//Generate a quad covering the whole viewport
+	const vec2 corner = vec2(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1);
+    gl_Position = vec4(2.0*corner - vec2(1.0), 0.0, 1.0);
+}
\ No newline at end of file
@@ -5,27 +5,81 @@
 #include "frame.glsl"
 
 //Constants
+#define SHAPE_RECTANGLE 0
+#define SHAPE_ROUNDED_RECTANGLE 1
+#define SHAPE_ELLIPSE 2
+
 layout (constant_id = 0) const int SAMPLE_MODE = frame_SAMPLE_MODE_PASSTHOUGH;
+layout (constant_id = 1) const int SHAPE = SHAPE_RECTANGLE;
 
 //Vertex I/O
 layout(location = 0) in vec2 in_texCoord;
+layout(location = 1) flat in float in_opacity;
+layout(location = 2) in vec2 in_position;
 
 layout(location = 0) out vec4 out_color;
 
 //Uniform buffers
 layout(set = 1, binding = 1) uniform LayerDataBlock {
 	float opacity;
+	float cornerRadius;
+	vec2 shapeCenter;
+	vec2 shapeHalfSize;
 };
 
 //Frame descriptor set
 frame_descriptor_set(2)
 
+
+
+float rounded_rectangle_signed_distance(in vec2 p, in vec2 halfSize, in float radius) {
+	const vec2 q = abs(p) - halfSize + vec2(radius);
+	return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - radius;
+}
+
+float ellipse_signed_distance(in vec2 p, in vec2 radii) {
+	//First order approximation. Exact on the edge, which is what matters for AA
+	const float k0 = length(p / radii);
+	const float k1 = length(p / (radii*radii));
+	return k1 > 0.0 ? k0*(k0 - 1.0) / k1 : -min(radii.x, radii.y);
+}
+
+float shape_coverage() {
+	//Obtain the signed distance to the shape. Negative values lay inside
+	const vec2 p = in_position - shapeCenter;
+	float sDist;
+	switch(SHAPE) {
+	case SHAPE_ROUNDED_RECTANGLE:
+		sDist = rounded_rectangle_signed_distance(
+			p, 
+			shapeHalfSize, 
+			clamp(cornerRadius, 0.0, min(shapeHalfSize.x, shapeHalfSize.y))
+		);
+		break;
+	case SHAPE_ELLIPSE:
+		sDist = ellipse_signed_distance(p, shapeHalfSize);
+		break;
+	default: //SHAPE_RECTANGLE
+		return 1.0;
+	}
+
+	//Analytic coverage of the edge, measured in pixels
+	const float pixelSize = max(fwidth(sDist), 1e-6);
+	return clamp(0.5 - sDist/pixelSize, 0.0, 1.0);
+}
+
 void main() {
+	//Crop the shape
+	const float coverage = shape_coverage();
+	if(coverage <= 0.0) {
+		discard;
+	}
+
 	//Sample the color from the frame
 	vec4 color = frame_texture(SAMPLE_MODE, frame_sampler(2), in_texCoord);
 
-	//Apply the opacity to it
-	color.a *= opacity;
+	//Apply the opacity and the coverage to it
+	color.a *= opacity * in_opacity * coverage;
 
 	//Premultiply alpha for outputing
 	out_color = frame_premultiply_alpha(color);
@@ -1,10 +1,15 @@
 #version 450
 
+//Must match VideoSurface::MAX_KEYFRAME_COUNT
+#define MAX_KEYFRAME_COUNT 16
+
 //Vertex I/O
 layout(location = 0) in vec4 in_position;
 layout(location = 1) in vec2 in_texCoord;
 
 layout(location = 0) out vec2 out_texCoord;
+layout(location = 1) flat out float out_opacity;
+layout(location = 2) out vec2 out_position;
 
 //Uniform buffers
 layout(set = 0, binding = 0) uniform ProjectionBlock {
@@ -15,8 +20,78 @@ layout(set = 1, binding = 0) uniform ModelBlock {
 	mat4 modelMtx;
 };
 
+struct Keyframe {
+	vec4 positionTime;			//xyz: position, w: time
+	vec4 scaleRotationOpacity;	//xy: scale, z: rotation, w: opacity
+	vec4 easing;				//Cubic bezier control points towards the next keyframe
+};
+
+layout(set = 1, binding = 2) uniform AnimationBlock {
+	uint keyframeCount;
+	Keyframe keyframes[MAX_KEYFRAME_COUNT];
+};
+
+//Push constants
+layout(push_constant) uniform AnimationTimeBlock {
+	float animationTime; //Already wrapped into a single period
+};
+
+
+float ease(vec4 easing, float x) {
+	//Solve the curve parameter for x using Newton-Raphson
+	float t = x;
+	for(int i = 0; i < 4; ++i) {
+		const float s = 1.0 - t;
+		const float bx = 3.0*s*s*t*easing.x + 3.0*s*t*t*easing.z + t*t*t;
+		const float dx = 3.0*s*s*easing.x + 6.0*s*t*(easing.z - easing.x) + 3.0*t*t*(1.0 - easing.z);
+		if(abs(dx) < 1e-6) {
+			break;
+		}
+
+		t = clamp(t - (bx - x) / dx, 0.0, 1.0);
+	}
+
+	//Evaluate y for it
+	const float s = 1.0 - t;
+	return 3.0*s*s*t*easing.y + 3.0*s*t*t*easing.w + t*t*t;
+}
 
 void main() {
-    gl_Position = projectionMtx * modelMtx * in_position;
+	mat4 animationMtx = mat4(1.0);
+	float animationOpacity = 1.0;
+
+	if(keyframeCount > 0u) {
+		const float time = animationTime;
+
+		//Find the keyframes surrounding the current time
+		uint next = 0u;
+		while(next < keyframeCount && keyframes[next].positionTime.w <= time) {
+			++next;
+		}
+		const uint prev = max(next, 1u) - 1u;
+		next = min(next, keyframeCount - 1u);
+
+		//Interpolate between them
+		const float span = keyframes[next].positionTime.w - keyframes[prev].positionTime.w;
+		const float x = span > 0.0 ? clamp((time - keyframes[prev].positionTime.w) / span, 0.0, 1.0) : 0.0;
+		const float f = ease(keyframes[prev].easing, x);
+		const vec3 position = mix(keyframes[prev].positionTime.xyz, keyframes[next].positionTime.xyz, f);
+		const vec4 sro = mix(keyframes[prev].scaleRotationOpacity, keyframes[next].scaleRotationOpacity, f);
+
+		//Compose translation * rotation * scale
+		const float c = cos(sro.z);
+		const float s = sin(sro.z);
+		animationMtx = mat4(
+			vec4(+c*sro.x, s*sro.x, 0.0, 0.0),
+			vec4(-s*sro.y, c*sro.y, 0.0, 0.0),
+			vec4(0.0, 0.0, 1.0, 0.0),
+			vec4(position, 1.0)
+		);
+		animationOpacity = sro.w;
+	}
+
+	gl_Position = projectionMtx * modelMtx * animationMtx * in_position;
 	out_texCoord = in_texCoord;
+	out_position = in_position.xy;
+	out_opacity = animationOpacity;
 }
\ No newline at end of file
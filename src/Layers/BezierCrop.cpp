@@ -1,4 +1,9 @@
 #include <zuazo/Layers/BezierCrop.h>
+#include <zuazo/Layers/StencilMask.h>
+#include <zuazo/Renderers/Compositor.h>
+
+#include "BezierCropVertex.h"
+#include "PreferredVideoModes.h"
 
 #include <zuazo/Signal/Input.h>
 #include <zuazo/Signal/Output.h>
@@ -15,28 +20,37 @@
 
 #include <utility>
 #include <memory>
+#include <optional>
 #include <unordered_map>
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
+#include <limits>
+#include <cmath>
 
 namespace Zuazo::Layers {
 
 struct BezierCropImpl {
 	struct Open {
-		struct Vertex {
-			Vertex(	const Math::Vec2f& position, 
-					const Math::Vec2f& texCoord = Math::Vec2f(0), 
-					const Math::Vec3f& klm = Math::Vec3f(-1) ) noexcept
-				: position(position)
-				, texCoord(texCoord)
-				, klm(klm)
-			{
-			}
+		using Vertex = BezierCropVertex;
+
+		using Index = uint32_t;
+		using OutlineProcessor = Math::LoopBlinn::OutlineProcessor<float, Index>;
 
-			Math::Vec2f position;
-			Math::Vec2f texCoord;
-			Math::Vec3f klm;
+		struct Chunk {
+			size_t			firstIndex;
+			size_t			indexCount;
+			Math::Vec2f		min;
+			Math::Vec2f		max;
 		};
 
-		using Index = uint16_t;
+		struct ControlPoints {
+			std::array<Math::Vec2f, 4> points;
+			std::array<Math::Vec2f, 4> morphPoints;
+		};
+
+		static constexpr Index PRIMITIVE_RESTART_INDEX = std::numeric_limits<Index>::max();
+		static constexpr size_t CHUNK_INDEX_COUNT = 4096;
 
 		struct FragmentSpecializationConstants {
 			FragmentSpecializationConstants(uint32_t sampleMode = -1)
@@ -47,14 +61,37 @@ struct BezierCropImpl {
 			uint32_t sampleMode;
 		};
 
+		struct PushConstants {
+			uint32_t		subdivisions;
+			uint32_t		fringeCurves;
+			Math::Vec2f		viewportSize;
+		};
+
 		enum VertexLayout {
 			VERTEX_LOCATION_POSITION,
-			VERTEX_LOCATION_TEXCOORD,
 			VERTEX_LOCATION_KLM,
+			VERTEX_LOCATION_MORPH_POSITION,
+			VERTEX_LOCATION_MORPH_KLM,
 
 			VERTEX_LOCATION_COUNT
 		};
 
+		enum ControlPointLayout {
+			CONTROL_POINT_LOCATION_POINTS,
+			CONTROL_POINT_LOCATION_MORPH_POINTS = CONTROL_POINT_LOCATION_POINTS + 4,
+
+			CONTROL_POINT_LOCATION_COUNT = CONTROL_POINT_LOCATION_MORPH_POINTS + 4
+		};
+
+		enum PipelineType {
+			PIPELINE_TESSELLATED,
+			PIPELINE_STENCIL,
+			PIPELINE_COVER,
+			PIPELINE_EDGE,
+
+			PIPELINE_COUNT
+		};
+
 		enum DescriptorSets {
 			DESCRIPTOR_SET_RENDERER = RendererBase::DESCRIPTOR_SET,
 			DESCRIPTOR_SET_BEZIERCROP,
@@ -64,12 +101,30 @@ struct BezierCropImpl {
 		};
 
 		enum DescriptorBindings {
-			DESCRIPTOR_BINDING_MODEL_MATRIX,
+			DESCRIPTOR_BINDING_VERTEXDATA,
 			DESCRIPTOR_BINDING_LAYERDATA,
 
 			DESCRIPTOR_COUNT
 		};
 
+		enum VertexDataUniforms {
+			VERTEXDATA_UNIFORM_MODEL_MATRIX,
+			VERTEXDATA_UNIFORM_MORPH_FACTOR,
+			VERTEXDATA_UNIFORM_TEXCOORD_SCALE,
+			VERTEXDATA_UNIFORM_COVER_BOUNDS,
+			VERTEXDATA_UNIFORM_FILL_SIDE,
+
+			VERTEXDATA_UNIFORM_COUNT
+		};
+
+		static constexpr std::array<Utils::Area, VERTEXDATA_UNIFORM_COUNT> VERTEXDATA_UNIFORM_LAYOUT = {
+			Utils::Area(0,									sizeof(Math::Mat4x4f)	),	//VERTEXDATA_UNIFORM_MODEL_MATRIX
+			Utils::Area(sizeof(Math::Mat4x4f),				sizeof(float)			),	//VERTEXDATA_UNIFORM_MORPH_FACTOR
+			Utils::Area(sizeof(Math::Mat4x4f)+sizeof(Math::Vec2f),sizeof(Math::Vec2f)),	//VERTEXDATA_UNIFORM_TEXCOORD_SCALE
+			Utils::Area(sizeof(Math::Mat4x4f)+sizeof(Math::Vec4f),sizeof(Math::Vec4f)),	//VERTEXDATA_UNIFORM_COVER_BOUNDS
+			Utils::Area(sizeof(Math::Mat4x4f)+sizeof(Math::Vec4f)*2,sizeof(float)	),	//VERTEXDATA_UNIFORM_FILL_SIDE
+		};
+
 		enum LayerDataUniforms {
 			LAYERDATA_UNIFORM_LINECOLOR,
 			LAYERDATA_UNIFORM_LINEWIDTH,
@@ -87,45 +142,106 @@ struct BezierCropImpl {
 		};
 
 		static constexpr uint32_t VERTEX_BUFFER_BINDING = 0;
+		static constexpr size_t BUFFER_GROWTH_FACTOR = 2;
+		static constexpr size_t BUFFER_SHRINK_THRESHOLD = 4;
+		static constexpr size_t MAX_GEOMETRY_BUFFER_COUNT = 4; //Enough for the frames in flight
+		static constexpr size_t MAX_LOD_LEVEL_COUNT = 6;
+		static constexpr size_t MIN_LOD_SEGMENT_COUNT = 4;
+		static constexpr float LOD_SEGMENT_EXTENT = 8.0f; //In pixels
+		static constexpr float LOD_HYSTERESIS = 0.25f;
+		static constexpr float FLATTENING_TOLERANCE = 0.25f; //In pixels
+		static constexpr uint32_t MAX_SUBDIVISIONS = 64;
 
 		struct Resources {
 			Resources(	Graphics::UniformBuffer uniformBuffer,
 						vk::UniqueDescriptorPool descriptorPool )
-				: vertexBuffer()
-				, indexBuffer()
-				, uniformBuffer(std::move(uniformBuffer))
+				: uniformBuffer(std::move(uniformBuffer))
 				, descriptorPool(std::move(descriptorPool))
 			{
 			}
 
 			~Resources() = default;
 
-			Graphics::StagedBuffer								vertexBuffer;
-			Graphics::StagedBuffer								indexBuffer;
 			Graphics::UniformBuffer								uniformBuffer;
 			vk::UniqueDescriptorPool							descriptorPool;
 		};
 
+		struct GeometryBuffers {
+			struct Level {
+				uint32_t											firstIndex;
+				uint32_t											indexCount;
+				int32_t												vertexOffset;
+				uint32_t											firstSegment;
+				uint32_t											segmentCount;
+				float												maxSegmentExtent;
+			};
+
+			GeometryBuffers()
+				: vertexBuffer()
+				, indexBuffer()
+				, controlPointBuffer()
+				, indexType(vk::IndexType::eUint16)
+				, levels()
+			{
+			}
+
+			~GeometryBuffers() = default;
+
+			Graphics::StagedBuffer								vertexBuffer;
+			Graphics::StagedBuffer								indexBuffer;
+			Graphics::StagedBuffer								controlPointBuffer;
+			vk::IndexType										indexType;
+			std::vector<Level>									levels;
+		};
+
+		struct LodLevel {
+			std::vector<BezierCrop::BezierLoop>				crop;
+			std::vector<BezierCrop::BezierLoop>				morphTarget;
+			float											segmentExtent = 0.0f;
+
+			bool											tessellated = false;
+			OutlineProcessor								outlineProcessor;
+			OutlineProcessor								morphOutlineProcessor;
+			bool											morphCompatible = false;
+			std::vector<Index>								indices;
+			std::vector<Chunk>								chunks;
+		};
+
 		const Graphics::Vulkan&								vulkan;
 
 		std::shared_ptr<Resources>							resources;
+		std::vector<std::shared_ptr<GeometryBuffers>>		geometryBuffers;
+		size_t												currentGeometryBuffers;
 		vk::DescriptorSet									descriptorSet;
 		FragmentSpecializationConstants						fragmentSpec;
 
-		Math::LoopBlinn::OutlineProcessor<float, uint16_t>	outlineProcessor;
+		BezierCrop::RenderingMode							renderingMode;
+		bool												morphable;
+		std::vector<LodLevel>								lodLevels;
+		std::unordered_map<const RendererBase*, size_t>		rendererLodLevels;
+		bool												lodLevelsExhausted;
+		std::vector<ControlPoints>							controlPoints;
+		Math::Vec4f											controlPointBounds;
+		Math::Mat4x4f										modelMatrix;
+		bool												modelMatrixPending;
+		std::optional<float>								pendingOpacity;
 		Graphics::Frame::Geometry							frameGeometry;
 
-		bool												flushVertexBuffer;
-		bool												flushIndexBuffer;
+		bool												flushGeometry;
 
 		vk::DescriptorSetLayout								frameDescriptorSetLayout;
 		vk::PipelineLayout									pipelineLayout;
 		vk::Pipeline										pipeline;
+		vk::Pipeline										stencilPipeline;
+		vk::Pipeline										edgePipeline;
 
 		Open(	const Graphics::Vulkan& vulkan,
 				Math::Vec2f size,
 				ScalingMode scalingMode,
+				BezierCrop::RenderingMode renderingMode,
 				Utils::BufferView<const BezierCrop::BezierLoop> crop,
+				Utils::BufferView<const BezierCrop::BezierLoop> morphTarget,
+				float morphFactor,
 				const Math::Transformf& transform,
 				const Math::Vec4f& lineColor,
 				float lineWidth,
@@ -134,19 +250,33 @@ struct BezierCropImpl {
 			: vulkan(vulkan)
 			, resources(Utils::makeShared<Resources>(	createUniformBuffer(vulkan),
 														createDescriptorPool(vulkan) ))
+			, geometryBuffers()
+			, currentGeometryBuffers(0)
 			, descriptorSet(createDescriptorSet(vulkan, *resources->descriptorPool))
-			, outlineProcessor()
+			, renderingMode(renderingMode)
+			, morphable(false)
+			, lodLevels()
+			, rendererLodLevels()
+			, lodLevelsExhausted(false)
+			, controlPoints()
+			, controlPointBounds(0)
+			, modelMatrix()
+			, modelMatrixPending(false)
+			, pendingOpacity()
 			, frameGeometry(scalingMode, size)
-			, flushVertexBuffer(false)
-			, flushIndexBuffer(false)
+			, flushGeometry(false)
 			, frameDescriptorSetLayout()
 			, pipelineLayout()
 			, pipeline()
+			, stencilPipeline()
+			, edgePipeline()
 		{
 			resources->uniformBuffer.writeDescirptorSet(vulkan, descriptorSet);
 
-			setCrop(crop);
+			setCrop(crop, morphTarget);
 			updateModelMatrixUniform(transform);
+			updateMorphFactorUniform(morphFactor);
+			updateTexCoordScaleUniform();
 			updateLineColorUniform(lineColor);
 			updateLineWidthUniform(lineWidth);
 			updateLineSmoothnessUniform(lineSmoothness);
@@ -154,16 +284,33 @@ struct BezierCropImpl {
 		}
 
 		~Open() {
-			resources->vertexBuffer.waitCompletion(vulkan);
+			for(const auto& geometry : geometryBuffers) {
+				if(geometry) {
+					geometry->vertexBuffer.waitCompletion(vulkan);
+					geometry->indexBuffer.waitCompletion(vulkan);
+					geometry->controlPointBuffer.waitCompletion(vulkan);
+				}
+			}
 			resources->uniformBuffer.waitCompletion(vulkan);
 		}
 
 		void recreate() 
 		{
-			
+			//This will enforce recreation when the next frame is rendered
+			frameDescriptorSetLayout = nullptr;
+		}
+
+		void setRenderingMode(	BezierCrop::RenderingMode mode,
+								Utils::BufferView<const BezierCrop::BezierLoop> crop,
+								Utils::BufferView<const BezierCrop::BezierLoop> morphTarget ) 
+		{
+			renderingMode = mode;
+			setCrop(crop, morphTarget);
+			recreate();
 		}
 
-		void draw(	Graphics::CommandBuffer& cmd, 
+		void draw(	const RendererBase& renderer,
+					Graphics::CommandBuffer& cmd, 
 					const Video& frame, 
 					ScalingFilter filter,
 					vk::RenderPass renderPass,
@@ -173,21 +320,30 @@ struct BezierCropImpl {
 			assert(resources);			
 			assert(frame);
 
-			//Update the vertex buffer if needed
+			//Update the texture coordinate mapping if needed
 			if(frameGeometry.useFrame(*frame)) {
-				//Size has changed. Recalculate the vertex buffer
-				flushVertexBuffer = true;
+				//Size has changed. Geometry remains untouched
+				updateTexCoordScaleUniform();
 			}
 
+			//Choose the geometry detail according to the size on screen
+			const auto mvp = renderer.getCamera().calculateMatrix(renderer.getViewportSize()) * modelMatrix;
+			const auto pixelsPerUnit = calculatePixelsPerUnit(controlPointBounds, mvp, renderer.getViewportSize());
+			const auto lodLevel = 	(renderingMode == BezierCrop::RenderingMode::tessellated) ?
+									selectLodLevel(renderer, pixelsPerUnit) :
+									0 ;
+
 			//Upload vertex and index data if necessary
-			fillVertexBuffer();
-			fillIndexBuffer();
+			uploadGeometry();
+			const auto geometry = geometryBuffers.empty() ? nullptr : geometryBuffers[currentGeometryBuffers];
 
 			//Only draw if geometry is defined
-			if(resources->indexBuffer.size()) {
-				assert(resources->vertexBuffer.size());
+			if(geometry && lodLevel < geometry->levels.size() && geometry->levels[lodLevel].segmentCount) {
+				const auto& level = geometry->levels[lodLevel];
+				assert(geometry->controlPointBuffer.size());
 
 				//Flush the unform buffer
+				writePendingUniforms();
 				resources->uniformBuffer.flush(vulkan);
 
 				//Configure the sampler for propper operation
@@ -195,22 +351,9 @@ struct BezierCropImpl {
 				assert(frameDescriptorSetLayout);
 				assert(pipelineLayout);
 				assert(pipeline);
+				assert(edgePipeline);
 
-				//Bind the pipeline and its descriptor sets
-				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-
-				cmd.bindVertexBuffers(
-					VERTEX_BUFFER_BINDING,											//Binding
-					resources->vertexBuffer.getBuffer(),							//Vertex buffers
-					0UL																//Offsets
-				);
-
-				cmd.bindIndexBuffer(
-					resources->indexBuffer.getBuffer(),								//Index buffer
-					0,																//Offset
-					vk::IndexType::eUint16											//Index type
-				);
-
+				//Bind the descriptor sets
 				cmd.bindDescriptorSets(
 					vk::PipelineBindPoint::eGraphics,								//Pipeline bind point
 					pipelineLayout,													//Pipeline layout
@@ -226,38 +369,196 @@ struct BezierCropImpl {
 					filter															//Filter
 				);
 
+				//Flatten curves according to their size on screen
+				const PushConstants pushConstants = {
+					calculateSubdivisions(level.maxSegmentExtent * pixelsPerUnit),
+					renderingMode == BezierCrop::RenderingMode::stencilCover,
+					renderer.getViewportSize()
+				};
+
+				cmd.get().pushConstants(
+					pipelineLayout,													//Pipeline layout
+					vk::ShaderStageFlagBits::eVertex,								//Shader stages
+					0, sizeof(pushConstants),										//Offset, size
+					&pushConstants													//Data
+				);
+
 				//Draw the frame and finish recording
-				cmd.drawIndexed(
-					resources->indexBuffer.size() / sizeof(Index),					//Index count
-					1, 																//Instance count
-					0, 																//First index
-					0, 																//First vertex
-					0																//First instance
+				if(renderingMode == BezierCrop::RenderingMode::stencilCover) {
+					assert(stencilPipeline);
+
+					cmd.bindVertexBuffers(
+						VERTEX_BUFFER_BINDING,										//Binding
+						geometry->controlPointBuffer.getBuffer(),					//Vertex buffers
+						0UL															//Offsets
+					);
+
+					//Accumulate the winding number of a triangle fan on the stencil
+					cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, stencilPipeline);
+					cmd.draw(
+						3*pushConstants.subdivisions,								//Vertex count
+						level.segmentCount,											//Instance count
+						0,															//First vertex
+						level.firstSegment											//First instance
+					);
+
+					//Cover the bounds where the winding is non-zero. This also resets the stencil
+					cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+					cmd.draw(
+						4,															//Vertex count
+						1,															//Instance count
+						0,															//First vertex
+						0															//First instance
+					);
+				} else if(level.indexCount) {
+					cmd.bindVertexBuffers(
+						VERTEX_BUFFER_BINDING,										//Binding
+						geometry->vertexBuffer.getBuffer(),							//Vertex buffers
+						0UL															//Offsets
+					);
+
+					cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+
+					cmd.bindIndexBuffer(
+						geometry->indexBuffer.getBuffer(),							//Index buffer
+						0,															//Offset
+						geometry->indexType											//Index type
+					);
+
+					if(lodLevels[lodLevel].chunks.size() > 1) {
+						//Large geometry. Only draw the chunks that lay inside the viewport
+						drawVisibleChunks(cmd, lodLevels[lodLevel].chunks, mvp, level);
+					} else {
+						cmd.drawIndexed(
+							level.indexCount,										//Index count
+							1, 														//Instance count
+							level.firstIndex, 										//First index
+							level.vertexOffset, 									//First vertex
+							0														//First instance
+						);
+					}
+				}
+
+				//Antialias the hard edges and stroke the border along the outline
+				cmd.bindVertexBuffers(
+					VERTEX_BUFFER_BINDING,											//Binding
+					geometry->controlPointBuffer.getBuffer(),						//Vertex buffers
+					0UL																//Offsets
+				);
+
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, edgePipeline);
+				cmd.draw(
+					2*(pushConstants.subdivisions + 1),								//Vertex count
+					level.segmentCount,												//Instance count
+					0,																//First vertex
+					level.firstSegment												//First instance
 				);
 
 				//Add the dependencies to the command buffer
-				cmd.addDependencies({ resources, frame });
+				cmd.addDependencies({ resources, geometry, frame });
 			}		
 		}
 
-		void setCrop(Utils::BufferView<const BezierCrop::BezierLoop> crop) {
-			outlineProcessor.clear();
-			outlineProcessor.addOutline(crop);
+		void setCrop(	Utils::BufferView<const BezierCrop::BezierLoop> crop,
+						Utils::BufferView<const BezierCrop::BezierLoop> morphTarget ) 
+		{
+			//Coarser levels will be generated on demand
+			lodLevels.clear();
+			rendererLodLevels.clear();
+			lodLevelsExhausted = false;
+
+			//Bring both outlines to the same amount of segments, so that
+			//they can be interpolated
+			std::vector<BezierCrop::BezierLoop> source(crop.cbegin(), crop.cend());
+			std::vector<BezierCrop::BezierLoop> target(morphTarget.cbegin(), morphTarget.cend());
+			morphable = matchSegmentCounts(source, target);
+
+			auto& lodLevel = lodLevels.emplace_back();
+			lodLevel.crop = std::move(source);
+			if(morphable) {
+				lodLevel.morphTarget = std::move(target);
+			}
+			lodLevel.segmentExtent = calculateSegmentExtent(lodLevel.crop);
+
+			//The control polygons enclose the shape
+			controlPointBounds = calculateBounds(lodLevel.crop, getMorphTarget(lodLevel));
+			updateCoverBoundsUniform(controlPointBounds);
+			updateFillSideUniform(calculateFillSide(lodLevel.crop));
+
+			if(renderingMode == BezierCrop::RenderingMode::tessellated) {
+				//Stencil and cover only needs the control points. Otherwise, 
+				//both shapes also need to tessellate to the same topology
+				tessellate(lodLevel);
+				morphable = lodLevel.morphCompatible;
+			}
 			
-			flushIndexBuffer = true;
-			flushVertexBuffer = true;
+			flushGeometry = true;
 		}
 
 		void updateModelMatrixUniform(const Math::Transformf& transform) {
+			//Needed right away for the LOD selection, but written on the
+			//next draw, so that frequent changes coalesce
+			modelMatrix = transform.calculateMatrix();
+			modelMatrixPending = true;
+		}
+
+		void updateMorphFactorUniform(float factor) {
+			assert(resources);
+			resources->uniformBuffer.waitCompletion(vulkan);
+
+			resources->uniformBuffer.write(
+				vulkan,
+				DESCRIPTOR_BINDING_VERTEXDATA,
+				&factor,
+				sizeof(factor),
+				VERTEXDATA_UNIFORM_LAYOUT[VERTEXDATA_UNIFORM_MORPH_FACTOR].offset()
+			);
+		}
+
+		void updateTexCoordScaleUniform() {
+			assert(resources);
+			resources->uniformBuffer.waitCompletion(vulkan);
+
+			//Texture coordinates are an affine function of the position:
+			//texCoord = 0.5 + position * texCoordScale
+			const auto surfaceSize = frameGeometry.calculateSurfaceSize();
+			const Math::Vec2f scale(
+				surfaceSize.first.x ? surfaceSize.second.x / surfaceSize.first.x : 0.0f,
+				surfaceSize.first.y ? surfaceSize.second.y / surfaceSize.first.y : 0.0f
+			);
+
+			resources->uniformBuffer.write(
+				vulkan,
+				DESCRIPTOR_BINDING_VERTEXDATA,
+				&scale,
+				sizeof(scale),
+				VERTEXDATA_UNIFORM_LAYOUT[VERTEXDATA_UNIFORM_TEXCOORD_SCALE].offset()
+			);
+		}
+
+		void updateCoverBoundsUniform(const Math::Vec4f& bounds) {
+			assert(resources);
+			resources->uniformBuffer.waitCompletion(vulkan);
+
+			resources->uniformBuffer.write(
+				vulkan,
+				DESCRIPTOR_BINDING_VERTEXDATA,
+				&bounds,
+				sizeof(bounds),
+				VERTEXDATA_UNIFORM_LAYOUT[VERTEXDATA_UNIFORM_COVER_BOUNDS].offset()
+			);
+		}
+
+		void updateFillSideUniform(float side) {
 			assert(resources);
 			resources->uniformBuffer.waitCompletion(vulkan);
 
-			const auto mtx = transform.calculateMatrix();
 			resources->uniformBuffer.write(
 				vulkan,
-				DESCRIPTOR_BINDING_MODEL_MATRIX,
-				&mtx,
-				sizeof(mtx)
+				DESCRIPTOR_BINDING_VERTEXDATA,
+				&side,
+				sizeof(side),
+				VERTEXDATA_UNIFORM_LAYOUT[VERTEXDATA_UNIFORM_FILL_SIDE].offset()
 			);
 		}
 
@@ -301,16 +602,39 @@ struct BezierCropImpl {
 		}
 
 		void updateOpacityUniform(float opa) {
+			//Written on the next draw, so that frequent changes coalesce
+			pendingOpacity = opa;
+		}
+
+		void writePendingUniforms() {
 			assert(resources);
-			resources->uniformBuffer.waitCompletion(vulkan);			
 
-			resources->uniformBuffer.write(
-				vulkan,
-				DESCRIPTOR_BINDING_LAYERDATA,
-				&opa,
-				sizeof(opa),
-				LAYERDATA_UNIFORM_LAYOUT[LAYERDATA_UNIFORM_OPACITY].offset()
-			);
+			if(modelMatrixPending || pendingOpacity) {
+				resources->uniformBuffer.waitCompletion(vulkan);
+
+				if(modelMatrixPending) {
+					resources->uniformBuffer.write(
+						vulkan,
+						DESCRIPTOR_BINDING_VERTEXDATA,
+						&modelMatrix,
+						sizeof(modelMatrix),
+						VERTEXDATA_UNIFORM_LAYOUT[VERTEXDATA_UNIFORM_MODEL_MATRIX].offset()
+					);
+				}
+
+				if(pendingOpacity) {
+					resources->uniformBuffer.write(
+						vulkan,
+						DESCRIPTOR_BINDING_LAYERDATA,
+						&(*pendingOpacity),
+						sizeof(*pendingOpacity),
+						LAYERDATA_UNIFORM_LAYOUT[LAYERDATA_UNIFORM_OPACITY].offset()
+					);
+				}
+
+				modelMatrixPending = false;
+				pendingOpacity.reset();
+			}
 		}
 
 	private:
@@ -331,132 +655,833 @@ struct BezierCropImpl {
 
 				//Recreate stuff
 				pipelineLayout = createPipelineLayout(vulkan, frameDescriptorSetLayout);
-				pipeline = createPipeline(vulkan, pipelineLayout, renderPass, blendingMode, renderingLayer, fragmentSpec);
-			}
-		}
 
-		void fillVertexBuffer() {
-			assert(resources);
+				switch(renderingMode) {
+				case BezierCrop::RenderingMode::stencilCover:
+					stencilPipeline = createPipeline(vulkan, PIPELINE_STENCIL, pipelineLayout, renderPass, blendingMode, renderingLayer, fragmentSpec);
+					pipeline = createPipeline(vulkan, PIPELINE_COVER, pipelineLayout, renderPass, blendingMode, renderingLayer, fragmentSpec);
+					break;
 
-			if(flushVertexBuffer) {
-				const auto surfaceSize = frameGeometry.calculateSurfaceSize();
-				const auto& vertices = outlineProcessor.getVertices();
+				default:
+					stencilPipeline = vk::Pipeline();
+					pipeline = createPipeline(vulkan, PIPELINE_TESSELLATED, pipelineLayout, renderPass, blendingMode, renderingLayer, fragmentSpec);
+					break;
+				}
 
-				//Wait for any previous transfers
-				resources->vertexBuffer.waitCompletion(vulkan);
+				edgePipeline = createPipeline(vulkan, PIPELINE_EDGE, pipelineLayout, renderPass, blendingMode, renderingLayer, fragmentSpec);
+			}
+		}
 
-				//Recreate if size has changed
-				if(resources->vertexBuffer.size() != vertices.size()*sizeof(Vertex)) {
-					resources->vertexBuffer = createVertexBuffer(vulkan, vertices.size());
+		void uploadGeometry() {
+			if(flushGeometry) {
+				//Write into a buffer which is not being drawn
+				const auto next = acquireGeometryBuffers();
+				const auto& geometry = geometryBuffers[next];
+
+				//All the tessellated levels are uploaded, so that switching 
+				//between them does not require any transfer. Coarser levels 
+				//are small in comparison with the first one
+				size_t vertexCount = 0;
+				size_t indexCount = 0;
+				size_t maxLevelVertexCount = 0;
+				for(const auto& lodLevel : lodLevels) {
+					if(lodLevel.tessellated) {
+						const auto levelVertexCount = lodLevel.outlineProcessor.getVertices().size();
+						vertexCount += levelVertexCount;
+						indexCount += lodLevel.indices.size();
+						maxLevelVertexCount = std::max(maxLevelVertexCount, levelVertexCount);
+					}
 				}
 
-				//Obtain the buffer data
-				Utils::BufferView<Vertex> vertexBufferData(
-					reinterpret_cast<Vertex*>(resources->vertexBuffer.data()),
-					resources->vertexBuffer.size() / sizeof(Vertex)
-				);
+				//Use 16 bit indices whenever possible. They are relative to 
+				//each level. Note that the largest value is reserved for 
+				//primitive restart
+				const bool useShortIndices = 
+					maxLevelVertexCount < std::numeric_limits<uint16_t>::max();
+				const size_t indexSize = useShortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+				geometry->indexType = useShortIndices ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+
+				//Ensure that there is enough space
+				reserveBuffer(vulkan, geometry->vertexBuffer, vk::BufferUsageFlagBits::eVertexBuffer, vertexCount*sizeof(Vertex));
+				reserveBuffer(vulkan, geometry->indexBuffer, vk::BufferUsageFlagBits::eIndexBuffer, indexCount*indexSize);
+				assert(geometry->vertexBuffer.size() >= vertexCount*sizeof(Vertex));
+				assert(geometry->indexBuffer.size() >= indexCount*indexSize);
+
+				controlPoints.clear();
+				geometry->levels.clear();
+				vertexCount = 0;
+				indexCount = 0;
+				for(const auto& lodLevel : lodLevels) {
+					GeometryBuffers::Level level;
+
+					//Control points are used by the edges and the stencil
+					level.firstSegment = controlPoints.size();
+					level.maxSegmentExtent = appendControlPoints(controlPoints, lodLevel.crop, getMorphTarget(lodLevel));
+					level.segmentCount = controlPoints.size() - level.firstSegment;
+
+					level.firstIndex = indexCount;
+					level.indexCount = 0;
+					level.vertexOffset = vertexCount;
+					if(lodLevel.tessellated) {
+						const auto& vertices = lodLevel.outlineProcessor.getVertices();
+						const auto& morphVertices = lodLevel.morphCompatible ? lodLevel.morphOutlineProcessor.getVertices() : vertices;
+						const auto& indices = lodLevel.indices;
+						assert(vertices.size() == morphVertices.size());
+
+						//Pack the vertex data straight into the staging memory
+						packBezierCropVertices(
+							reinterpret_cast<Vertex*>(geometry->vertexBuffer.data()) + vertexCount,
+							vertices.data(),
+							morphVertices.data(),
+							vertices.size()
+						);
+
+						//Copy the index data
+						if(useShortIndices) {
+							auto* dst = reinterpret_cast<uint16_t*>(geometry->indexBuffer.data()) + indexCount;
+							for(size_t i = 0; i < indices.size(); ++i) {
+								dst[i] = 	(indices[i] == PRIMITIVE_RESTART_INDEX) ? 
+											std::numeric_limits<uint16_t>::max() : 
+											static_cast<uint16_t>(indices[i]) ;
+							}
+						} else {
+							std::memcpy(
+								reinterpret_cast<Index*>(geometry->indexBuffer.data()) + indexCount, 
+								indices.data(), 
+								indices.size()*sizeof(Index)
+							);
+						}
+
+						level.indexCount = indices.size();
+						vertexCount += vertices.size();
+						indexCount += indices.size();
+					}
+
+					geometry->levels.push_back(level);
+				}
 
-				//Ensure the size is correct
-				assert(vertexBufferData.size() == vertices.size());
+				//Flush the buffers
+				if(indexCount) {
+					geometry->vertexBuffer.flushData(
+						vulkan, 
+						vulkan.getTransferQueueIndex(), 
+						vk::AccessFlagBits::eVertexAttributeRead,
+						vk::PipelineStageFlagBits::eVertexInput
+					);
 
-				//Copy the data
-				for(size_t i = 0; i < vertexBufferData.size(); ++i) {
-					//Obtain the interpolation parameter based on the position
-					const auto t = Math::ilerp(
-						-surfaceSize.first / 2.0f, 
-						+surfaceSize.first / 2.0f, 
-						vertices[i].pos
+					geometry->indexBuffer.flushData(
+						vulkan, 
+						vulkan.getTransferQueueIndex(), 
+						vk::AccessFlagBits::eIndexRead,
+						vk::PipelineStageFlagBits::eVertexInput
 					);
+				}
 
-					//Interpolate the texture coordinates
-					const auto texCoord = Math::lerp(
-						(Math::Vec2f(1.0f) - surfaceSize.second) / 2.0f,
-						(Math::Vec2f(1.0f) + surfaceSize.second) / 2.0f,
-						t
+				reserveBuffer(vulkan, geometry->controlPointBuffer, vk::BufferUsageFlagBits::eVertexBuffer, controlPoints.size()*sizeof(ControlPoints));
+				if(controlPoints.size()) {
+					std::memcpy(
+						geometry->controlPointBuffer.data(),
+						controlPoints.data(),
+						controlPoints.size()*sizeof(ControlPoints)
 					);
 
-					vertexBufferData[i] = Vertex(
-						vertices[i].pos,
-						texCoord,
-						vertices[i].klm
+					geometry->controlPointBuffer.flushData(
+						vulkan, 
+						vulkan.getTransferQueueIndex(), 
+						vk::AccessFlagBits::eVertexAttributeRead,
+						vk::PipelineStageFlagBits::eVertexInput
 					);
 				}
 
-				//Flush the buffer
-				resources->vertexBuffer.flushData(
-					vulkan, 
-					vulkan.getTransferQueueIndex(), 
-					vk::AccessFlagBits::eVertexAttributeRead,
-					vk::PipelineStageFlagBits::eVertexInput
+				//Present the new geometry
+				currentGeometryBuffers = next;
+				flushGeometry = false;
+			}
+
+			assert(!flushGeometry);
+		}
+
+		size_t acquireGeometryBuffers() {
+			//Look for buffers which are no longer referenced by a pending 
+			//command buffer, starting from the least recently presented one. 
+			//Reusing them keeps their capacity
+			for(size_t i = 1; i <= geometryBuffers.size(); ++i) {
+				const auto index = (currentGeometryBuffers + i) % geometryBuffers.size();
+				const auto& geometry = geometryBuffers[index];
+
+				if(geometry.use_count() == 1) {
+					//Last transfer was issued a few updates ago, so this should not block
+					geometry->vertexBuffer.waitCompletion(vulkan);
+					geometry->indexBuffer.waitCompletion(vulkan);
+					geometry->controlPointBuffer.waitCompletion(vulkan);
+					return index;
+				}
+			}
+
+			//All of them are in flight. Grow the ring, placing the new buffers 
+			//so that they become the most recently presented ones
+			const auto index = geometryBuffers.empty() ? 0 : currentGeometryBuffers + 1;
+			if(geometryBuffers.size() < MAX_GEOMETRY_BUFFER_COUNT) {
+				geometryBuffers.insert(
+					geometryBuffers.cbegin() + index, 
+					Utils::makeShared<GeometryBuffers>()
 				);
+				return index;
+			}
+
+			//Too many frames in flight. Release the oldest one. Its memory
+			//will be kept alive by the command buffers using it
+			const auto oldest = index % geometryBuffers.size();
+			geometryBuffers[oldest] = Utils::makeShared<GeometryBuffers>();
+			return oldest;
+		}
 
-				flushVertexBuffer = false;
+		static const std::vector<BezierCrop::BezierLoop>& getMorphTarget(const LodLevel& lodLevel) noexcept {
+			//Tessellated levels also require the same topology to be morphed
+			const bool morph = 	lodLevel.tessellated ? 
+								lodLevel.morphCompatible : 
+								!lodLevel.morphTarget.empty() ;
+			return morph ? lodLevel.morphTarget : lodLevel.crop;
+		}
+
+		static float appendControlPoints(	std::vector<ControlPoints>& controlPoints,
+											Utils::BufferView<const BezierCrop::BezierLoop> crop,
+											Utils::BufferView<const BezierCrop::BezierLoop> morphTarget ) 
+		{
+			assert(crop.size() == morphTarget.size());
+			float maxSegmentExtent = 0.0f;
+
+			auto morphLoop = morphTarget.cbegin();
+			for(const auto& loop : crop) {
+				assert(loop.getSegmentCount() == morphLoop->getSegmentCount());
+
+				for(size_t i = 0; i < loop.getSegmentCount(); ++i) {
+					const auto segment = loop.getSegment(i);
+					const auto morphSegment = morphLoop->getSegment(i);
+
+					ControlPoints cp;
+					for(size_t j = 0; j < cp.points.size(); ++j) {
+						cp.points[j] = segment[j];
+						cp.morphPoints[j] = morphSegment[j];
+					}
+
+					maxSegmentExtent = std::max({
+						maxSegmentExtent,
+						calculateSegmentExtent(cp.points),
+						calculateSegmentExtent(cp.morphPoints)
+					});
+
+					controlPoints.push_back(cp);
+				}
+
+				++morphLoop;
 			}
 
-			assert(!flushVertexBuffer);
+			return maxSegmentExtent;
 		}
 
-		void fillIndexBuffer() {
-			assert(resources);
+		static Math::Vec4f calculateBounds(	Utils::BufferView<const BezierCrop::BezierLoop> crop,
+											Utils::BufferView<const BezierCrop::BezierLoop> morphTarget ) noexcept
+		{
+			Math::Vec2f min(std::numeric_limits<float>::max());
+			Math::Vec2f max(std::numeric_limits<float>::lowest());
+
+			for(const auto& loops : { crop, morphTarget }) {
+				for(const auto& loop : loops) {
+					for(size_t i = 0; i < loop.getSegmentCount(); ++i) {
+						//The control polygon encloses the curve
+						const auto segment = loop.getSegment(i);
+						for(size_t j = 0; j < 4; ++j) {
+							min.x = std::min(min.x, segment[j].x);
+							min.y = std::min(min.y, segment[j].y);
+							max.x = std::max(max.x, segment[j].x);
+							max.y = std::max(max.y, segment[j].y);
+						}
+					}
+				}
+			}
+
+			return 	(min.x <= max.x && min.y <= max.y) ?
+					Math::Vec4f(min.x, min.y, max.x, max.y) :
+					Math::Vec4f(0) ;
+		}
+
+		static float calculateFillSide(Utils::BufferView<const BezierCrop::BezierLoop> crop) noexcept {
+			//Shoelace formula over the control polygons. Its sign tells on
+			//which side of the outline the fill lays
+			float signedArea = 0.0f;
+
+			for(const auto& loop : crop) {
+				for(size_t i = 0; i < loop.getSegmentCount(); ++i) {
+					const auto segment = loop.getSegment(i);
+					for(size_t j = 1; j < 4; ++j) {
+						const auto& a = segment[j - 1];
+						const auto& b = segment[j];
+						signedArea += a.x*b.y - b.x*a.y;
+					}
+				}
+			}
+
+			return signedArea < 0.0f ? -1.0f : 1.0f;
+		}
+
+		size_t selectLodLevel(const RendererBase& renderer, float pixelsPerUnit) {
+			assert(lodLevels.size());
+			const auto getExtent = [this, pixelsPerUnit] (size_t level) -> float {
+				return lodLevels[level].segmentExtent * pixelsPerUnit;
+			};
+
+			//Each renderer keeps its own level, as the layer may be shown at 
+			//different sizes. All of them are resident on the GPU
+			auto& level = rendererLodLevels[&renderer];
+			level = std::min(level, lodLevels.size() - 1);
+
+			//Use the coarsest level whose segments are not larger than a few 
+			//pixels. Thresholds are separated by a hysteresis band, so that 
+			//small size changes do not switch back and forth
+			while(level > 0 && getExtent(level) > LOD_SEGMENT_EXTENT * (1.0f + LOD_HYSTERESIS)) {
+				--level; //Too coarse
+			}
+
+			while(level + 1 < MAX_LOD_LEVEL_COUNT) {
+				if(level + 1 == lodLevels.size() && !generateLodLevel()) {
+					break; //Can not be simplified further
+				}
+
+				assert(level + 1 < lodLevels.size());
+				if(getExtent(level + 1) > LOD_SEGMENT_EXTENT * (1.0f - LOD_HYSTERESIS)) {
+					break; //Next one would be too coarse
+				}
+
+				++level;
+			}
+
+			//Candidate levels are only tessellated and uploaded once they 
+			//are actually used
+			auto& selected = lodLevels[level];
+			if(!selected.tessellated) {
+				tessellate(selected);
+				flushGeometry = true;
+			}
+
+			return level;
+		}
+
+		static float calculatePixelsPerUnit(const Math::Vec4f& bounds,
+											const Math::Mat4x4f& mvp, 
+											Math::Vec2f viewportSize ) noexcept
+		{
+			const Math::Vec2f min(bounds.x, bounds.y);
+			const Math::Vec2f max(bounds.z, bounds.w);
+			float result = 0.0f;
+
+			if(max.x > min.x && max.y > min.y) {
+				Math::Vec2f projectedMin(std::numeric_limits<float>::max());
+				Math::Vec2f projectedMax(std::numeric_limits<float>::lowest());
+				for(const auto& corner : { min, Math::Vec2f(max.x, min.y), Math::Vec2f(min.x, max.y), max }) {
+					const auto clip = mvp * Math::Vec4f(corner, 0.0f, 1.0f);
+					const auto pixel = Math::Vec2f(clip.x, clip.y) / std::max(std::abs(clip.w), std::numeric_limits<float>::epsilon()) * viewportSize / 2.0f;
+					projectedMin.x = std::min(projectedMin.x, pixel.x);
+					projectedMin.y = std::min(projectedMin.y, pixel.y);
+					projectedMax.x = std::max(projectedMax.x, pixel.x);
+					projectedMax.y = std::max(projectedMax.y, pixel.y);
+				}
+
+				const auto extent = max - min;
+				const auto projectedExtent = projectedMax - projectedMin;
+				result = std::max(projectedExtent.x / extent.x, projectedExtent.y / extent.y);
+			}
+
+			return result;
+		}
+
+		static uint32_t calculateSubdivisions(float extent) noexcept {
+			//The deviation of a flattened curve decreases quadratically with 
+			//the amount of pieces. Extent is expressed in pixels
+			const auto subdivisions = std::ceil(std::sqrt(extent / (8.0f * FLATTENING_TOLERANCE)));
+			return std::clamp(static_cast<uint32_t>(subdivisions), 1U, MAX_SUBDIVISIONS);
+		}
+
+		bool generateLodLevel() {
+			assert(lodLevels.size());
+			if(lodLevelsExhausted) {
+				return false; //Already known, avoid simplifying again
+			}
+
+			const auto& last = lodLevels.back();
+
+			//Halve the amount of segments of each loop
+			LodLevel next;
+			next.crop.reserve(last.crop.size());
+			bool simplified = false;
+			for(const auto& loop : last.crop) {
+				next.crop.push_back(simplifyLoop(loop));
+				simplified |= next.crop.back().getSegmentCount() < loop.getSegmentCount();
+			}
+
+			next.morphTarget.reserve(last.morphTarget.size());
+			for(const auto& loop : last.morphTarget) {
+				next.morphTarget.push_back(simplifyLoop(loop));
+			}
+
+			if(simplified) {
+				//Only its extent is needed to decide whether it is used
+				next.segmentExtent = calculateSegmentExtent(next.crop);
+				lodLevels.emplace_back(std::move(next));
+			} else {
+				lodLevelsExhausted = true;
+			}
+
+			return simplified;
+		}
+
+		void tessellate(LodLevel& lodLevel) {
+			lodLevel.outlineProcessor.clear();
+			lodLevel.outlineProcessor.addOutline(lodLevel.crop);
+
+			lodLevel.morphOutlineProcessor.clear();
+			if(lodLevel.morphTarget.size()) {
+				lodLevel.morphOutlineProcessor.addOutline(lodLevel.morphTarget);
+			}
 
-			if(flushIndexBuffer) {
-				const auto& indices = outlineProcessor.getIndices();
+			//Morphing is only possible when both shapes tessellate to the same 
+			//topology. Otherwise only the source crop will be rendered
+			lodLevel.morphCompatible = isMorphCompatible(lodLevel.outlineProcessor, lodLevel.morphOutlineProcessor);
 
-				//Wait for any previous transfers
-				resources->indexBuffer.waitCompletion(vulkan);
+			//Sort the geometry into spatially coherent chunks
+			buildChunks(lodLevel);
+			lodLevel.tessellated = true;
+		}
+
+		static void buildChunks(LodLevel& lodLevel) {
+			struct Strip {
+				size_t			begin;
+				size_t			end;
+				Math::Vec2f		min;
+				Math::Vec2f		max;
+				uint32_t		mortonCode;
+			};
+
+			const auto& vertices = lodLevel.outlineProcessor.getVertices();
+			const auto& morphVertices = lodLevel.morphCompatible ? lodLevel.morphOutlineProcessor.getVertices() : vertices;
+			const auto& srcIndices = lodLevel.outlineProcessor.getIndices();
+			auto& indices = lodLevel.indices;
+			auto& chunks = lodLevel.chunks;
+
+			indices.clear();
+			chunks.clear();
+
+			//Split the index list into triangle strips, obtaining their boundaries
+			std::vector<Strip> strips;
+			Math::Vec2f totalMin(std::numeric_limits<float>::max());
+			Math::Vec2f totalMax(std::numeric_limits<float>::lowest());
+			for(size_t i = 0; i < srcIndices.size(); ) {
+				Strip strip = {
+					i, i,
+					Math::Vec2f(std::numeric_limits<float>::max()),
+					Math::Vec2f(std::numeric_limits<float>::lowest()),
+					0
+				};
+
+				for(; strip.end < srcIndices.size() && srcIndices[strip.end] != PRIMITIVE_RESTART_INDEX; ++strip.end) {
+					const auto index = srcIndices[strip.end];
+					for(const auto& position : { vertices[index].pos, morphVertices[index].pos }) {
+						strip.min.x = std::min(strip.min.x, position.x);
+						strip.min.y = std::min(strip.min.y, position.y);
+						strip.max.x = std::max(strip.max.x, position.x);
+						strip.max.y = std::max(strip.max.y, position.y);
+					}
+				}
 
-				//Recreate if size has changed
-				if(resources->indexBuffer.size() != indices.size()*sizeof(Index)) {
-					resources->indexBuffer = createIndexBuffer(vulkan, indices.size());
+				if(strip.end > strip.begin) {
+					totalMin.x = std::min(totalMin.x, strip.min.x);
+					totalMin.y = std::min(totalMin.y, strip.min.y);
+					totalMax.x = std::max(totalMax.x, strip.max.x);
+					totalMax.y = std::max(totalMax.y, strip.max.y);
+					strips.push_back(strip);
 				}
 
-				//Ensure the size is correct
-				assert(resources->indexBuffer.size() == indices.size()*sizeof(Index));
+				i = strip.end + 1; //Skip the restart index
+			}
+
+			if(srcIndices.size() > CHUNK_INDEX_COUNT) {
+				//Sort the strips along a Z-order curve, so that consecutive 
+				//strips are close to each other
+				const auto extent = totalMax - totalMin;
+				for(auto& strip : strips) {
+					const auto center = (strip.min + strip.max) / 2.0f;
+					strip.mortonCode = calculateMortonCode(
+						extent.x > 0 ? (center.x - totalMin.x) / extent.x : 0.0f,
+						extent.y > 0 ? (center.y - totalMin.y) / extent.y : 0.0f
+					);
+				}
 
-				//Copy the data
-				std::memcpy(
-					resources->indexBuffer.data(), 
-					indices.data(), 
-					indices.size()*sizeof(Index)
+				std::stable_sort(
+					strips.begin(), strips.end(),
+					[] (const Strip& a, const Strip& b) -> bool {
+						return a.mortonCode < b.mortonCode;
+					}
 				);
+			}
+
+			//Write the indices, grouping strips into chunks
+			indices.reserve(srcIndices.size() + 1);
+			for(const auto& strip : strips) {
+				if(chunks.empty() || chunks.back().indexCount >= CHUNK_INDEX_COUNT) {
+					chunks.push_back(Chunk{
+						indices.size(), 0,
+						Math::Vec2f(std::numeric_limits<float>::max()),
+						Math::Vec2f(std::numeric_limits<float>::lowest())
+					});
+				}
 
-				//Flush the buffer
-				resources->indexBuffer.flushData(
-					vulkan, 
-					vulkan.getTransferQueueIndex(), 
-					vk::AccessFlagBits::eIndexRead,
-					vk::PipelineStageFlagBits::eVertexInput
+				auto& chunk = chunks.back();
+				indices.insert(indices.cend(), srcIndices.cbegin() + strip.begin, srcIndices.cbegin() + strip.end);
+				indices.push_back(PRIMITIVE_RESTART_INDEX);
+				chunk.indexCount = indices.size() - chunk.firstIndex;
+				chunk.min.x = std::min(chunk.min.x, strip.min.x);
+				chunk.min.y = std::min(chunk.min.y, strip.min.y);
+				chunk.max.x = std::max(chunk.max.x, strip.max.x);
+				chunk.max.y = std::max(chunk.max.y, strip.max.y);
+			}
+		}
+
+		static void drawVisibleChunks(	Graphics::CommandBuffer& cmd, 
+										Utils::BufferView<const Chunk> chunks,
+										const Math::Mat4x4f& mvp,
+										const GeometryBuffers::Level& level ) 
+		{
+			size_t firstIndex = 0;
+			size_t indexCount = 0;
+
+			for(const auto& chunk : chunks) {
+				if(isVisible(chunk, mvp)) {
+					if(indexCount && firstIndex + indexCount == chunk.firstIndex) {
+						//Contiguous to the previous range. Merge them
+						indexCount += chunk.indexCount;
+					} else {
+						//Start a new range
+						if(indexCount) {
+							cmd.drawIndexed(indexCount, 1, level.firstIndex + firstIndex, level.vertexOffset, 0);
+						}
+
+						firstIndex = chunk.firstIndex;
+						indexCount = chunk.indexCount;
+					}
+				}
+			}
+
+			if(indexCount) {
+				cmd.drawIndexed(indexCount, 1, level.firstIndex + firstIndex, level.vertexOffset, 0);
+			}
+		}
+
+		bool isTessellated() const noexcept {
+			return lodLevels.size() && lodLevels.front().tessellated;
+		}
+
+		bool isInside(Math::Vec2f point, float morphFactor) const {
+			assert(isTessellated());
+
+			//Use the finest level, as it represents the actual crop
+			const auto& lodLevel = lodLevels.front();
+			const auto& vertices = lodLevel.outlineProcessor.getVertices();
+			const auto& morphVertices = lodLevel.morphCompatible ? lodLevel.morphOutlineProcessor.getVertices() : vertices;
+			const auto& indices = lodLevel.indices;
+			const auto factor = lodLevel.morphCompatible ? morphFactor : 0.0f;
+
+			const auto getVertex = [&] (Index index) -> std::pair<Math::Vec2f, Math::Vec3f> {
+				const auto& source = vertices[index];
+				const auto& target = morphVertices[index];
+				return std::make_pair(
+					source.pos + (target.pos - source.pos) * factor,
+					source.klm + (target.klm - source.klm) * factor
 				);
+			};
 
-				flushIndexBuffer = false;
+			for(const auto& chunk : lodLevel.chunks) {
+				//Discard whole chunks by their boundaries
+				if(	point.x < chunk.min.x || point.x > chunk.max.x ||
+					point.y < chunk.min.y || point.y > chunk.max.y )
+				{
+					continue;
+				}
+
+				//Test every triangle of the strips
+				size_t stripLength = 0;
+				for(size_t i = chunk.firstIndex; i < chunk.firstIndex + chunk.indexCount; ++i) {
+					if(indices[i] == PRIMITIVE_RESTART_INDEX) {
+						stripLength = 0;
+					} else if(++stripLength >= 3) {
+						const std::array triangle = {
+							getVertex(indices[i - 2]),
+							getVertex(indices[i - 1]),
+							getVertex(indices[i - 0])
+						};
+
+						if(isInside(point, triangle)) {
+							return true;
+						}
+					}
+				}
 			}
 
-			assert(!flushIndexBuffer);
+			return false;
 		}
 
+		static bool isInside(	Math::Vec2f point, 
+								const std::array<std::pair<Math::Vec2f, Math::Vec3f>, 3>& triangle ) noexcept
+		{
+			const auto& [a, klmA] = triangle[0];
+			const auto& [b, klmB] = triangle[1];
+			const auto& [c, klmC] = triangle[2];
+
+			//Obtain the barycentric coordinates of the point
+			const auto ab = b - a;
+			const auto ac = c - a;
+			const auto ap = point - a;
+			const auto det = ab.x*ac.y - ab.y*ac.x;
+			if(det == 0.0f) {
+				return false; //Degenerate triangle
+			}
 
+			const auto v = (ap.x*ac.y - ap.y*ac.x) / det;
+			const auto w = (ab.x*ap.y - ab.y*ap.x) / det;
+			const auto u = 1.0f - v - w;
+			if(u < 0.0f || v < 0.0f || w < 0.0f) {
+				return false; //Outside the triangle
+			}
 
-		static Graphics::StagedBuffer createVertexBuffer(const Graphics::Vulkan& vulkan, size_t vertexCount) {
-			if(vertexCount > 0) {
-				return Graphics::StagedBuffer(
-					vulkan,
-					vk::BufferUsageFlagBits::eVertexBuffer,
-					sizeof(Vertex) * vertexCount
-				);
-			} else {
-				return {};
+			//Evaluate the implicit form of the curve as the fragment shader
+			//does. Negative values lay inside
+			const auto klm = klmA*u + klmB*v + klmC*w;
+			return klm.x*klm.x*klm.x - klm.y*klm.z <= 0.0f;
+		}
+
+		static bool isVisible(const Chunk& chunk, const Math::Mat4x4f& mvp) noexcept {
+			const std::array corners = {
+				mvp * Math::Vec4f(chunk.min.x, chunk.min.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(chunk.max.x, chunk.min.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(chunk.min.x, chunk.max.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(chunk.max.x, chunk.max.y, 0.0f, 1.0f)
+			};
+
+			//Conservative test: Only reject if all the corners lay 
+			//outside the same clipping plane
+			const auto allOutside = [&corners] (auto predicate) -> bool {
+				return std::all_of(corners.cbegin(), corners.cend(), predicate);
+			};
+
+			return !(
+				allOutside([] (const Math::Vec4f& v) { return v.x < -v.w; }) ||
+				allOutside([] (const Math::Vec4f& v) { return v.x > +v.w; }) ||
+				allOutside([] (const Math::Vec4f& v) { return v.y < -v.w; }) ||
+				allOutside([] (const Math::Vec4f& v) { return v.y > +v.w; })
+			);
+		}
+
+		static uint32_t calculateMortonCode(float x, float y) noexcept {
+			const auto spread = [] (uint32_t v) -> uint32_t {
+				v &= 0x0000FFFF;
+				v = (v | (v << 8)) & 0x00FF00FF;
+				v = (v | (v << 4)) & 0x0F0F0F0F;
+				v = (v | (v << 2)) & 0x33333333;
+				v = (v | (v << 1)) & 0x55555555;
+				return v;
+			};
+
+			constexpr float SCALE = std::numeric_limits<uint16_t>::max();
+			const auto qx = static_cast<uint32_t>(std::clamp(x, 0.0f, 1.0f) * SCALE);
+			const auto qy = static_cast<uint32_t>(std::clamp(y, 0.0f, 1.0f) * SCALE);
+			return spread(qx) | (spread(qy) << 1);
+		}
+
+		static bool isMorphable(BezierCrop::RenderingMode renderingMode,
+								Utils::BufferView<const BezierCrop::BezierLoop> crop,
+								Utils::BufferView<const BezierCrop::BezierLoop> morphTarget )
+		{
+			std::vector<BezierCrop::BezierLoop> source(crop.cbegin(), crop.cend());
+			std::vector<BezierCrop::BezierLoop> target(morphTarget.cbegin(), morphTarget.cend());
+			bool result = matchSegmentCounts(source, target);
+
+			if(result && renderingMode == BezierCrop::RenderingMode::tessellated) {
+				//The tessellations need to match as well
+				OutlineProcessor sourceOutline;
+				OutlineProcessor targetOutline;
+				sourceOutline.addOutline(source);
+				targetOutline.addOutline(target);
+				result = isMorphCompatible(sourceOutline, targetOutline);
+			}
+
+			return result;
+		}
+
+		static bool matchSegmentCounts(	std::vector<BezierCrop::BezierLoop>& source,
+										std::vector<BezierCrop::BezierLoop>& target )
+		{
+			if(source.size() != target.size()) {
+				return false; //Loops can not be paired
+			}
+
+			for(size_t i = 0; i < source.size(); ++i) {
+				const auto sourceCount = source[i].getSegmentCount();
+				const auto targetCount = target[i].getSegmentCount();
+
+				if(sourceCount < targetCount) {
+					if(sourceCount == 0) {
+						return false;
+					}
+
+					source[i] = subdivideLoop(source[i], targetCount);
+				} else if(targetCount < sourceCount) {
+					if(targetCount == 0) {
+						return false;
+					}
+
+					target[i] = subdivideLoop(target[i], sourceCount);
+				}
+
+				assert(source[i].getSegmentCount() == target[i].getSegmentCount());
 			}
+
+			return true;
 		}
 
-		static Graphics::StagedBuffer createIndexBuffer(const Graphics::Vulkan& vulkan, size_t indexCount) {
-			if(indexCount > 0) {
-				return Graphics::StagedBuffer(
-					vulkan,
-					vk::BufferUsageFlagBits::eIndexBuffer,
-					sizeof(Index) * indexCount
+		static BezierCrop::BezierLoop subdivideLoop(const BezierCrop::BezierLoop& loop, size_t segmentCount) {
+			using Segment = std::array<Math::Vec2f, 4>;
+			assert(loop.getSegmentCount() > 0);
+			assert(loop.getSegmentCount() <= segmentCount);
+
+			std::vector<Segment> segments;
+			segments.reserve(segmentCount);
+			for(size_t i = 0; i < loop.getSegmentCount(); ++i) {
+				const auto segment = loop.getSegment(i);
+				segments.push_back({ segment[0], segment[1], segment[2], segment[3] });
+			}
+
+			//Split the largest segment in halves until the count is reached.
+			//This does not modify the shape
+			while(segments.size() < segmentCount) {
+				const auto largest = std::max_element(
+					segments.cbegin(), segments.cend(),
+					[] (const Segment& a, const Segment& b) -> bool {
+						return calculateSegmentExtent(a) < calculateSegmentExtent(b);
+					}
 				);
-			} else {
-				return {};
+				const auto index = std::distance(segments.cbegin(), largest);
+				const auto s = *largest;
+
+				//De Casteljau's algorithm at t=0.5
+				const auto p01 = (s[0] + s[1]) / 2.0f;
+				const auto p12 = (s[1] + s[2]) / 2.0f;
+				const auto p23 = (s[2] + s[3]) / 2.0f;
+				const auto p012 = (p01 + p12) / 2.0f;
+				const auto p123 = (p12 + p23) / 2.0f;
+				const auto p0123 = (p012 + p123) / 2.0f;
+
+				segments[index] = Segment{ s[0], p01, p012, p0123 };
+				segments.insert(segments.cbegin() + index + 1, Segment{ p0123, p123, p23, s[3] });
+			}
+
+			//The last point of each segment is the first of the next one
+			std::vector<std::array<Math::Vec2f, 3>> points;
+			points.reserve(segments.size());
+			for(const auto& segment : segments) {
+				points.push_back({ segment[0], segment[1], segment[2] });
+			}
+
+			return BezierCrop::BezierLoop(Utils::BufferView<const std::array<Math::Vec2f, 3>>(points));
+		}
+
+		static BezierCrop::BezierLoop simplifyLoop(const BezierCrop::BezierLoop& loop) {
+			const auto segmentCount = loop.getSegmentCount();
+			if(segmentCount <= MIN_LOD_SEGMENT_COUNT) {
+				return loop; //Already simple enough
+			}
+
+			std::vector<std::array<Math::Vec2f, 3>> points;
+			points.reserve((segmentCount + 1) / 2);
+			for(size_t i = 0; i < segmentCount; i += 2) {
+				const auto first = loop.getSegment(i);
+
+				if(i + 1 < segmentCount) {
+					//Join consecutive segments preserving the tangents at the
+					//ends. As the parameter span doubles, so do the handles
+					const auto second = loop.getSegment(i + 1);
+					points.push_back({
+						first[0],
+						first[0] + 2.0f*(first[1] - first[0]),
+						second[3] + 2.0f*(second[2] - second[3])
+					});
+				} else {
+					points.push_back({ first[0], first[1], first[2] });
+				}
+			}
+
+			return BezierCrop::BezierLoop(Utils::BufferView<const std::array<Math::Vec2f, 3>>(points));
+		}
+
+		static float calculateSegmentExtent(Utils::BufferView<const BezierCrop::BezierLoop> loops) {
+			//Obtain the average size of the segments
+			float sum = 0.0f;
+			size_t count = 0;
+
+			for(const auto& loop : loops) {
+				for(size_t i = 0; i < loop.getSegmentCount(); ++i) {
+					const auto segment = loop.getSegment(i);
+					sum += calculateSegmentExtent(std::array<Math::Vec2f, 4>{ segment[0], segment[1], segment[2], segment[3] });
+					++count;
+				}
+			}
+
+			return count ? sum / count : 0.0f;
+		}
+
+		static float calculateSegmentExtent(const std::array<Math::Vec2f, 4>& segment) noexcept {
+			//Largest side of the control polygon's boundaries
+			Math::Vec2f min(std::numeric_limits<float>::max());
+			Math::Vec2f max(std::numeric_limits<float>::lowest());
+			for(const auto& point : segment) {
+				min.x = std::min(min.x, point.x);
+				min.y = std::min(min.y, point.y);
+				max.x = std::max(max.x, point.x);
+				max.y = std::max(max.y, point.y);
+			}
+
+			return std::max(max.x - min.x, max.y - min.y);
+		}
+
+		static bool isMorphCompatible(	const OutlineProcessor& source,
+										const OutlineProcessor& target ) 
+		{
+			const auto& sourceIndices = source.getIndices();
+			const auto& targetIndices = target.getIndices();
+
+			return 	source.getVertices().size() == target.getVertices().size() &&
+					std::equal(
+						sourceIndices.cbegin(), sourceIndices.cend(),
+						targetIndices.cbegin(), targetIndices.cend()
+					);
+		}
+
+		static void reserveBuffer(	const Graphics::Vulkan& vulkan,
+									Graphics::StagedBuffer& buffer,
+									vk::BufferUsageFlags usage,
+									size_t size )
+		{
+			//Grow geometrically and only shrink when the usage drops well 
+			//below the capacity, so that small edits never reallocate
+			const auto capacity = buffer.size();
+			if(size > capacity || size < capacity / BUFFER_SHRINK_THRESHOLD) {
+				if(size > 0) {
+					buffer = Graphics::StagedBuffer(
+						vulkan,
+						usage,
+						size * BUFFER_GROWTH_FACTOR
+					);
+				} else {
+					buffer = Graphics::StagedBuffer();
+				}
 			}
 		}
 
@@ -469,7 +1494,7 @@ struct BezierCropImpl {
 				//Create the bindings
 				const std::array bindings = {
 					vk::DescriptorSetLayoutBinding(	//UBO binding
-						DESCRIPTOR_BINDING_MODEL_MATRIX,				//Binding
+						DESCRIPTOR_BINDING_VERTEXDATA,					//Binding
 						vk::DescriptorType::eUniformBuffer,				//Type
 						1,												//Count
 						vk::ShaderStageFlagBits::eVertex,				//Shader stage
@@ -479,7 +1504,8 @@ struct BezierCropImpl {
 						DESCRIPTOR_BINDING_LAYERDATA,					//Binding
 						vk::DescriptorType::eUniformBuffer,				//Type
 						1,												//Count
-						vk::ShaderStageFlagBits::eFragment,				//Shader stage
+						vk::ShaderStageFlagBits::eVertex |				//Shader stage
+						vk::ShaderStageFlagBits::eFragment,
 						nullptr											//Immutable samplers
 					), 
 				};
@@ -497,7 +1523,7 @@ struct BezierCropImpl {
 
 		static Utils::BufferView<const std::pair<uint32_t, size_t>> getUniformBufferSizes() noexcept {
 			static const std::array uniformBufferSizes = {
-				std::make_pair<uint32_t, size_t>(DESCRIPTOR_BINDING_MODEL_MATRIX, 	sizeof(Math::Mat4x4f) ),
+				std::make_pair<uint32_t, size_t>(DESCRIPTOR_BINDING_VERTEXDATA, 	VERTEXDATA_UNIFORM_LAYOUT.back().end() ),
 				std::make_pair<uint32_t, size_t>(DESCRIPTOR_BINDING_LAYERDATA,		LAYERDATA_UNIFORM_LAYOUT.back().end() )
 			};
 
@@ -546,10 +1572,17 @@ struct BezierCropImpl {
 					frameDescriptorSetLayout 								//DESCRIPTOR_SET_FRAME
 				};
 
+				constexpr std::array pushConstants = {
+					vk::PushConstantRange(
+						vk::ShaderStageFlagBits::eVertex,				//Shader stages
+						0, sizeof(PushConstants)						//Offset, size
+					)
+				};
+
 				const vk::PipelineLayoutCreateInfo createInfo(
 					{},													//Flags
 					layouts.size(), layouts.data(),						//Descriptor set layouts
-					0, nullptr											//Push constants
+					pushConstants.size(), pushConstants.data()			//Push constants
 				);
 
 				result = vulkan.createPipelineLayout(id, createInfo);
@@ -558,7 +1591,25 @@ struct BezierCropImpl {
 			return result;
 		}
 
+		static vk::ShaderModule getShaderModule(const Graphics::Vulkan& vulkan,
+												Utils::BufferView<const uint32_t> code )
+		{
+			//Use the code's address as an identifier
+			const size_t id = reinterpret_cast<uintptr_t>(code.data());
+
+			//Try to retrive modules from cache
+			auto result = vulkan.createShaderModule(id);
+			if(!result) {
+				//Modules isn't in cache. Create it
+				result = vulkan.createShaderModule(id, code);
+			}
+
+			assert(result);
+			return result;
+		}
+
 		static vk::Pipeline createPipeline(	const Graphics::Vulkan& vulkan,
+											PipelineType type,
 											vk::PipelineLayout layout,
 											vk::RenderPass renderPass,
 											BlendingMode blendingMode,
@@ -566,7 +1617,8 @@ struct BezierCropImpl {
 											const FragmentSpecializationConstants& fragmentSpec )
 		{
 			using FragmentSpecializationData = std::array<uint32_t, sizeof(FragmentSpecializationConstants) / sizeof(uint32_t)>;
-			using Index = std::tuple<	vk::PipelineLayout,
+			using Index = std::tuple<	PipelineType,
+										vk::PipelineLayout,
 										vk::RenderPass,
 										BlendingMode,
 										RenderingLayer,
@@ -579,7 +1631,7 @@ struct BezierCropImpl {
 			std::memcpy(fragmentSpecData.data(), &fragmentSpec, sizeof(fragmentSpec));
 
 			//Obtain the id related to the configuration
-			Index index(layout, renderPass, blendingMode, renderingLayer, fragmentSpecData);
+			Index index(type, layout, renderPass, blendingMode, renderingLayer, fragmentSpecData);
 			const auto& id = ids[index]; //TODO concurrency
 
 			//Try to obtain it from cache
@@ -588,26 +1640,44 @@ struct BezierCropImpl {
 				//No luck, we need to create it
 				static //So that its ptr can be used as an identifier
 				#include <bezier_crop_vert.h>
-				const size_t vertId = reinterpret_cast<uintptr_t>(bezier_crop_vert);
 				static
 				#include <bezier_crop_frag.h>
-				const size_t fragId = reinterpret_cast<uintptr_t>(bezier_crop_frag);
-
-				//Try to retrive modules from cache
-				auto vertexShader = vulkan.createShaderModule(vertId);
-				if(!vertexShader) {
-					//Modules isn't in cache. Create it
-					vertexShader = vulkan.createShaderModule(vertId, bezier_crop_vert);
-				}
-
-				auto fragmentShader = vulkan.createShaderModule(fragId);
-				if(!fragmentShader) {
-					//Modules isn't in cache. Create it
-					fragmentShader = vulkan.createShaderModule(fragId, bezier_crop_frag);
+				static
+				#include <bezier_crop_stencil_vert.h>
+				static
+				#include <bezier_crop_cover_vert.h>
+				static
+				#include <bezier_crop_cover_frag.h>
+				static
+				#include <bezier_crop_edge_vert.h>
+				static
+				#include <bezier_crop_edge_frag.h>
+
+				vk::ShaderModule vertexShader;
+				vk::ShaderModule fragmentShader;
+				switch(type) {
+				case PIPELINE_STENCIL:
+					vertexShader = getShaderModule(vulkan, bezier_crop_stencil_vert);
+					break;
+
+				case PIPELINE_COVER:
+					vertexShader = getShaderModule(vulkan, bezier_crop_cover_vert);
+					fragmentShader = getShaderModule(vulkan, bezier_crop_cover_frag);
+					break;
+
+				case PIPELINE_EDGE:
+					vertexShader = getShaderModule(vulkan, bezier_crop_edge_vert);
+					fragmentShader = getShaderModule(vulkan, bezier_crop_edge_frag);
+					break;
+
+				default:
+					vertexShader = getShaderModule(vulkan, bezier_crop_vert);
+					fragmentShader = getShaderModule(vulkan, bezier_crop_frag);
+					break;
 				}
 
 				assert(vertexShader);
-				assert(fragmentShader);
+				assert(fragmentShader || type == PIPELINE_STENCIL);
 
 				//Specialization info
 				constexpr std::array<vk::SpecializationMapEntry, 1> fragmentShaderSpecializationMap = {
@@ -625,22 +1695,25 @@ struct BezierCropImpl {
 
 				constexpr auto SHADER_ENTRY_POINT = "main";
 				const std::array shaderStages = {
-					vk::PipelineShaderStageCreateInfo(		
+					vk::PipelineShaderStageCreateInfo(
 						{},												//Flags
 						vk::ShaderStageFlagBits::eVertex,				//Shader type
 						vertexShader,									//Shader handle
 						SHADER_ENTRY_POINT,								//Shader entry point
-						nullptr 										//Specialization constants
-					),							
-					vk::PipelineShaderStageCreateInfo(		
+						nullptr											//Specialization constants
+					),
+					vk::PipelineShaderStageCreateInfo(
 						{},												//Flags
 						vk::ShaderStageFlagBits::eFragment,				//Shader type
 						fragmentShader,									//Shader handle
 						SHADER_ENTRY_POINT,								//Shader entry point
 						&fragmentShaderSpecializationInfo 				//Specialization constants
-					),	
+					),
 				};
 
+				//The stencil pass does not have a fragment shader
+				const uint32_t shaderStageCount = fragmentShader ? shaderStages.size() : 1;
+
 				constexpr std::array vertexBindings = {
 					vk::VertexInputBindingDescription(
 						VERTEX_BUFFER_BINDING,
@@ -657,30 +1730,103 @@ struct BezierCropImpl {
 						offsetof(Vertex, position)
 					),
 					vk::VertexInputAttributeDescription(
-						VERTEX_LOCATION_TEXCOORD,
+						VERTEX_LOCATION_KLM,
+						VERTEX_BUFFER_BINDING,
+						vk::Format::eR32G32B32Sfloat,
+						offsetof(Vertex, klm)
+					),
+					vk::VertexInputAttributeDescription(
+						VERTEX_LOCATION_MORPH_POSITION,
 						VERTEX_BUFFER_BINDING,
 						vk::Format::eR32G32Sfloat,
-						offsetof(Vertex, texCoord)
+						offsetof(Vertex, morphPosition)
 					),
 					vk::VertexInputAttributeDescription(
-						VERTEX_LOCATION_KLM,
+						VERTEX_LOCATION_MORPH_KLM,
 						VERTEX_BUFFER_BINDING,
 						vk::Format::eR32G32B32Sfloat,
-						offsetof(Vertex, klm)
+						offsetof(Vertex, morphKlm)
 					)
 				};
 
-				const vk::PipelineVertexInputStateCreateInfo vertexInput(
-					{},
-					vertexBindings.size(), vertexBindings.data(),		//Vertex bindings
-					vertexAttributes.size(), vertexAttributes.data()	//Vertex attributes
-				);
+				//One instance per cubic segment
+				constexpr std::array controlPointBindings = {
+					vk::VertexInputBindingDescription(
+						VERTEX_BUFFER_BINDING,
+						sizeof(ControlPoints),
+						vk::VertexInputRate::eInstance
+					)
+				};
 
-				constexpr vk::PipelineInputAssemblyStateCreateInfo inputAssembly(
-					{},													//Flags
-					vk::PrimitiveTopology::eTriangleStrip,				//Topology
-					true												//Restart enable
-				);
+				std::array<vk::VertexInputAttributeDescription, CONTROL_POINT_LOCATION_COUNT> controlPointAttributes;
+				for(size_t i = 0; i < std::tuple_size<decltype(ControlPoints::points)>::value; ++i) {
+					controlPointAttributes[CONTROL_POINT_LOCATION_POINTS + i] = vk::VertexInputAttributeDescription(
+						CONTROL_POINT_LOCATION_POINTS + i,
+						VERTEX_BUFFER_BINDING,
+						vk::Format::eR32G32Sfloat,
+						offsetof(ControlPoints, points) + i*sizeof(Math::Vec2f)
+					);
+
+					controlPointAttributes[CONTROL_POINT_LOCATION_MORPH_POINTS + i] = vk::VertexInputAttributeDescription(
+						CONTROL_POINT_LOCATION_MORPH_POINTS + i,
+						VERTEX_BUFFER_BINDING,
+						vk::Format::eR32G32Sfloat,
+						offsetof(ControlPoints, morphPoints) + i*sizeof(Math::Vec2f)
+					);
+				}
+
+				vk::PipelineVertexInputStateCreateInfo vertexInput;
+				vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
+				switch(type) {
+				case PIPELINE_STENCIL:
+					vertexInput = vk::PipelineVertexInputStateCreateInfo(
+						{},
+						controlPointBindings.size(), controlPointBindings.data(),		//Vertex bindings
+						controlPointAttributes.size(), controlPointAttributes.data()	//Vertex attributes
+					);
+					inputAssembly = vk::PipelineInputAssemblyStateCreateInfo(
+						{},												//Flags
+						vk::PrimitiveTopology::eTriangleList,			//Topology
+						false											//Restart enable
+					);
+					break;
+
+				case PIPELINE_EDGE:
+					//A strip per segment
+					vertexInput = vk::PipelineVertexInputStateCreateInfo(
+						{},
+						controlPointBindings.size(), controlPointBindings.data(),		//Vertex bindings
+						controlPointAttributes.size(), controlPointAttributes.data()	//Vertex attributes
+					);
+					inputAssembly = vk::PipelineInputAssemblyStateCreateInfo(
+						{},												//Flags
+						vk::PrimitiveTopology::eTriangleStrip,			//Topology
+						false											//Restart enable
+					);
+					break;
+
+				case PIPELINE_COVER:
+					//Vertices are generated on the shader
+					inputAssembly = vk::PipelineInputAssemblyStateCreateInfo(
+						{},												//Flags
+						vk::PrimitiveTopology::eTriangleStrip,			//Topology
+						false											//Restart enable
+					);
+					break;
+
+				default:
+					vertexInput = vk::PipelineVertexInputStateCreateInfo(
+						{},
+						vertexBindings.size(), vertexBindings.data(),		//Vertex bindings
+						vertexAttributes.size(), vertexAttributes.data()	//Vertex attributes
+					);
+					inputAssembly = vk::PipelineInputAssemblyStateCreateInfo(
+						{},												//Flags
+						vk::PrimitiveTopology::eTriangleStrip,			//Topology
+						true											//Restart enable
+					);
+					break;
+				}
 
 				constexpr vk::PipelineViewportStateCreateInfo viewport(
 					{},													//Flags
@@ -707,12 +1853,55 @@ struct BezierCropImpl {
 					false, false										//Alpha to coverage, alpha to 1 enable
 				);
 
-				const auto depthStencil = Graphics::getDepthStencilConfiguration(renderingLayer);
-
-				const std::array colorBlendAttachments = {
+				auto depthStencil = Graphics::getDepthStencilConfiguration(renderingLayer);
+				auto colorBlendAttachments = std::array{
 					Graphics::getBlendingConfiguration(blendingMode)
 				};
 
+				//Use the same test as the masked layers by default
+				depthStencil.stencilTestEnable = true;
+				depthStencil.front = StencilMask::getStencilTestConfiguration();
+				depthStencil.back = depthStencil.front;
+
+				switch(type) {
+				case PIPELINE_STENCIL:
+					//Accumulate the winding number where not masked out. Colour 
+					//is left untouched
+					depthStencil.depthWriteEnable = false;
+					depthStencil.front.passOp = vk::StencilOp::eIncrementAndWrap;
+					depthStencil.front.writeMask = StencilMask::STENCIL_WINDING_BITS;
+					depthStencil.back.passOp = vk::StencilOp::eDecrementAndWrap;
+					depthStencil.back.writeMask = StencilMask::STENCIL_WINDING_BITS;
+					colorBlendAttachments.front().colorWriteMask = {};
+					break;
+
+				case PIPELINE_COVER:
+					//Draw where the winding number is non-zero and clear it
+					//so that the stencil is left ready for the next layer.
+					//The mask bit is preserved
+					depthStencil.front = vk::StencilOpState(
+						vk::StencilOp::eKeep,							//Fail op
+						vk::StencilOp::eZero,							//Pass op
+						vk::StencilOp::eZero,							//Depth fail op
+						vk::CompareOp::eNotEqual,						//Compare op
+						StencilMask::STENCIL_WINDING_BITS,				//Compare mask
+						StencilMask::STENCIL_WINDING_BITS,				//Write mask
+						0												//Reference
+					);
+					depthStencil.back = depthStencil.front;
+					break;
+
+				case PIPELINE_EDGE:
+					//Drawn on top of the fill with its same blending mode. 
+					//It shares its depth
+					depthStencil.depthWriteEnable = false;
+					depthStencil.depthCompareOp = vk::CompareOp::eLessOrEqual;
+					break;
+
+				default:
+					break;
+				}
+
 				const vk::PipelineColorBlendStateCreateInfo colorBlend(
 					{},													//Flags
 					false,												//Enable logic operation
@@ -732,7 +1921,7 @@ struct BezierCropImpl {
 
 				const vk::GraphicsPipelineCreateInfo createInfo(
 					{},													//Flags
-					shaderStages.size(), shaderStages.data(),			//Shader stages
+					shaderStageCount, shaderStages.data(),				//Shader stages
 					&vertexInput,										//Vertex input
 					&inputAssembly,										//Vertex assembly
 					nullptr,											//Tesselation
@@ -764,7 +1953,11 @@ struct BezierCropImpl {
 	Input									videoIn;
 
 	Math::Vec2f								size;
+	BezierCrop::RenderingMode				renderingMode;
 	std::vector<BezierCrop::BezierLoop>		crop;
+	std::vector<BezierCrop::BezierLoop>		morphTarget;
+	Math::Vec4f								boundaries;
+	float									morphFactor;
 	Math::Vec4f								lineColor;
 	float									lineWidth;
 	float									lineSmoothness;
@@ -779,7 +1972,11 @@ struct BezierCropImpl {
 		: owner(owner)
 		, videoIn(owner, std::string(Signal::makeInputName<Video>()))
 		, size(size)
+		, renderingMode(BezierCrop::RenderingMode::tessellated)
 		, crop(crop.cbegin(), crop.cend())
+		, morphTarget()
+		, boundaries(calculateBoundaries(this->crop, this->morphTarget))
+		, morphFactor(0)
 		, lineColor(0)
 		, lineWidth(0)
 		, lineSmoothness(1)
@@ -804,7 +2001,10 @@ struct BezierCropImpl {
 					bezierCrop.getInstance().getVulkan(),
 					getSize(),
 					bezierCrop.getScalingMode(),
+					getRenderingMode(),
 					getCrop(),
+					getMorphTarget(),
+					getMorphFactor(),
 					bezierCrop.getTransform(),
 					bezierCrop.getLineColor(),
 					bezierCrop.getLineWidth(),
@@ -906,14 +2106,23 @@ struct BezierCropImpl {
 		assert(&owner.get() == &bezierCrop); (void)(bezierCrop);
 
 		if(opened) {
+			//Stencil and cover requires a stencil attachment. Otherwise fall
+			//back to tessellation until the rendering mode is set again
+			if(	opened->renderingMode == BezierCrop::RenderingMode::stencilCover &&
+				!StencilMask::hasStencilComponent(renderer.getDepthStencilFormat()) )
+			{
+				opened->setRenderingMode(BezierCrop::RenderingMode::tessellated, crop, morphTarget);
+			}
+
 			const auto& frame = videoIn.pull();
 			
 			//Draw
 			if(frame) {
 				opened->draw(
+					renderer,
 					cmd, 
 					frame, 
-					bezierCrop.getScalingFilter(),
+					Renderers::Compositor::limitScalingFilter(renderer, bezierCrop.getScalingFilter()),
 					bezierCrop.getRenderPass(),
 					bezierCrop.getBlendingMode(),
 					bezierCrop.getRenderingLayer()
@@ -997,13 +2206,35 @@ struct BezierCropImpl {
 		return size;
 	}
 
+	const Video& getLastFrame() const {
+		return videoIn.getLastElement();
+	}
+
+
+	void setRenderingMode(BezierCrop::RenderingMode mode) {
+		if(this->renderingMode != mode) {
+			this->renderingMode = mode;
+
+			if(opened) {
+				opened->setRenderingMode(this->renderingMode, this->crop, this->morphTarget);
+			}
+
+			lastFrames.clear(); //Will force hasChanged() to true
+		}
+	}
+
+	BezierCrop::RenderingMode getRenderingMode() const {
+		return renderingMode;
+	}
+
 
 	void setCrop(Utils::BufferView<const BezierCrop::BezierLoop> crop) {
 		this->crop.clear();
 		this->crop.insert(this->crop.cend(), crop.cbegin(), crop.cend());
+		boundaries = calculateBoundaries(this->crop, this->morphTarget);
 
 		if(opened) {
-			opened->setCrop(this->crop);
+			opened->setCrop(this->crop, this->morphTarget);
 		}
 
 		lastFrames.clear(); //Will force hasChanged() to true
@@ -1013,6 +2244,49 @@ struct BezierCropImpl {
 		return crop;
 	}
 
+
+	bool setMorphTarget(Utils::BufferView<const BezierCrop::BezierLoop> target) {
+		this->morphTarget.clear();
+		this->morphTarget.insert(this->morphTarget.cend(), target.cbegin(), target.cend());
+		boundaries = calculateBoundaries(this->crop, this->morphTarget);
+
+		if(opened) {
+			opened->setCrop(this->crop, this->morphTarget);
+		}
+
+		lastFrames.clear(); //Will force hasChanged() to true
+		return isMorphable();
+	}
+
+	Utils::BufferView<const BezierCrop::BezierLoop> getMorphTarget() const {
+		return morphTarget;
+	}
+
+	bool isMorphable() const {
+		return opened ? opened->morphable : Open::isMorphable(renderingMode, crop, morphTarget);
+	}
+
+	const Math::Vec4f& getBoundaries() const {
+		return boundaries;
+	}
+
+
+	void setMorphFactor(float factor) {
+		if(this->morphFactor != factor) {
+			this->morphFactor = factor;
+
+			if(opened) {
+				opened->updateMorphFactorUniform(this->morphFactor);
+			}
+
+			lastFrames.clear(); //Will force hasChanged() to true
+		}
+	}
+
+	float getMorphFactor() const {
+		return morphFactor;
+	}
+
 	void setLineColor(const Math::Vec4f& color) {
 		if(this->lineColor != color) {
 			this->lineColor = color;
@@ -1063,8 +2337,89 @@ struct BezierCropImpl {
 		return lineSmoothness;
 	}
 
+
+	bool isInside(Math::Vec2f point) const {
+		if(opened && opened->isTessellated()) {
+			//Reuse the tessellated geometry
+			return opened->isInside(point, morphFactor);
+		} else {
+			//Compute the winding number of the flattened outline
+			std::vector<BezierCrop::BezierLoop> source(crop.cbegin(), crop.cend());
+			std::vector<BezierCrop::BezierLoop> target(morphTarget.cbegin(), morphTarget.cend());
+			const auto morph = Open::matchSegmentCounts(source, target);
+			int32_t winding = 0;
+
+			for(size_t i = 0; i < source.size(); ++i) {
+				const auto& loop = source[i];
+				const auto& morphLoop = morph ? target[i] : loop;
+
+				for(size_t j = 0; j < loop.getSegmentCount(); ++j) {
+					const auto segment = loop.getSegment(j);
+					const auto morphSegment = morphLoop.getSegment(j);
+
+					std::array<Math::Vec2f, 4> points;
+					for(size_t k = 0; k < points.size(); ++k) {
+						points[k] = segment[k] + (morphSegment[k] - segment[k]) * (morph ? morphFactor : 0.0f);
+					}
+
+					auto prev = points[0];
+					for(size_t k = 1; k <= OUTLINE_SUBDIVISIONS; ++k) {
+						const auto t = static_cast<float>(k) / OUTLINE_SUBDIVISIONS;
+						const auto s = 1.0f - t;
+						const auto next = 	points[0]*(s*s*s) + 
+											points[1]*(3.0f*s*s*t) + 
+											points[2]*(3.0f*s*t*t) + 
+											points[3]*(t*t*t) ;
+						winding += calculateCrossing(point, prev, next);
+						prev = next;
+					}
+				}
+			}
+
+			return winding != 0;
+		}
+	}
+
+	static Math::Vec4f calculateBoundaries(	Utils::BufferView<const BezierCrop::BezierLoop> crop,
+											Utils::BufferView<const BezierCrop::BezierLoop> morphTarget )
+	{
+		//Consider both the shape and its morph target
+		Math::Vec2f min(std::numeric_limits<float>::max());
+		Math::Vec2f max(std::numeric_limits<float>::lowest());
+
+		for(const auto& loops : { crop, morphTarget }) {
+			for(const auto& loop : loops) {
+				const auto loopBoundaries = Math::getBoundaries(loop);
+				min.x = std::min(min.x, loopBoundaries.getMin().x);
+				min.y = std::min(min.y, loopBoundaries.getMin().y);
+				max.x = std::max(max.x, loopBoundaries.getMax().x);
+				max.y = std::max(max.y, loopBoundaries.getMax().y);
+			}
+		}
+
+		return 	(min.x <= max.x && min.y <= max.y) ?
+				Math::Vec4f(min.x, min.y, max.x, max.y) :
+				Math::Vec4f(0) ;
+	}
+
+	std::vector<VideoMode> getPreferredVideoModes() const {
+		return Layers::getPreferredVideoModes(owner.get().getInstance());
+	}
+
 	
 private:
+	static constexpr size_t OUTLINE_SUBDIVISIONS = 32;
+
+	static int32_t calculateCrossing(Math::Vec2f point, Math::Vec2f a, Math::Vec2f b) noexcept {
+		//Signed crossing of a horizontal ray towards +x with the line
+		const auto side = (b.x - a.x)*(point.y - a.y) - (point.x - a.x)*(b.y - a.y);
+		if(a.y <= point.y) {
+			return (b.y > point.y && side > 0.0f) ? +1 : 0; //Upwards
+		} else {
+			return (b.y <= point.y && side < 0.0f) ? -1 : 0; //Downwards
+		}
+	}
+
 	void recreateCallback(	BezierCrop& bezierCrop, 
 							vk::RenderPass renderPass,
 							BlendingMode blendingMode )
@@ -1141,6 +2496,19 @@ Math::Vec2f BezierCrop::getSize() const {
 	return (*this)->getSize();
 }
 
+const Video& BezierCrop::getLastFrame() const {
+	return (*this)->getLastFrame();
+}
+
+
+void BezierCrop::setRenderingMode(RenderingMode mode) {
+	(*this)->setRenderingMode(mode);
+}
+
+BezierCrop::RenderingMode BezierCrop::getRenderingMode() const {
+	return (*this)->getRenderingMode();
+}
+
 
 void BezierCrop::setCrop(Utils::BufferView<const BezierLoop> crop) {
 	(*this)->setCrop(crop);
@@ -1151,6 +2519,32 @@ Utils::BufferView<const BezierCrop::BezierLoop> BezierCrop::getCrop() const {
 }
 
 
+bool BezierCrop::setMorphTarget(Utils::BufferView<const BezierLoop> target) {
+	return (*this)->setMorphTarget(target);
+}
+
+Utils::BufferView<const BezierCrop::BezierLoop> BezierCrop::getMorphTarget() const {
+	return (*this)->getMorphTarget();
+}
+
+bool BezierCrop::isMorphable() const {
+	return (*this)->isMorphable();
+}
+
+const Math::Vec4f& BezierCrop::getBoundaries() const {
+	return (*this)->getBoundaries();
+}
+
+
+void BezierCrop::setMorphFactor(float factor) {
+	(*this)->setMorphFactor(factor);
+}
+
+float BezierCrop::getMorphFactor() const {
+	return (*this)->getMorphFactor();
+}
+
+
 void BezierCrop::setLineColor(const Math::Vec4f& color) {
 	(*this)->setLineColor(color);
 }
@@ -1177,4 +2571,13 @@ float BezierCrop::getLineSmoothness() const {
 	return (*this)->getLineSmoothness();
 }
 
+
+bool BezierCrop::isInside(Math::Vec2f point) const {
+	return (*this)->isInside(point);
+}
+
+std::vector<VideoMode> BezierCrop::getPreferredVideoModes() const {
+	return (*this)->getPreferredVideoModes();
+}
+
 }
\ No newline at end of file
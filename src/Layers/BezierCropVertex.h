@@ -0,0 +1,189 @@
+#pragma once
+
+#include <zuazo/Math/Vector.h>
+
+#include <type_traits>
+#include <cstddef>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#define ZUAZO_BEZIER_CROP_VERTEX_X86
+	#include <immintrin.h>
+#endif
+
+namespace Zuazo::Layers {
+
+//Vertex layout used by BezierCrop's tessellated pipeline. It is kept on its 
+//own so that the packing routines can be benchmarked out of the library
+struct BezierCropVertex {
+	BezierCropVertex(	const Math::Vec2f& position, 
+						const Math::Vec3f& klm = Math::Vec3f(-1),
+						const Math::Vec2f& morphPosition = Math::Vec2f(0), 
+						const Math::Vec3f& morphKlm = Math::Vec3f(-1) ) noexcept
+		: position(position)
+		, klm(klm)
+		, morphPosition(morphPosition)
+		, morphKlm(morphKlm)
+	{
+	}
+
+	Math::Vec2f position;
+	Math::Vec3f klm;
+	Math::Vec2f morphPosition;
+	Math::Vec3f morphKlm;
+};
+
+static_assert(std::is_standard_layout_v<BezierCropVertex>, "Unexpected vertex layout");
+static_assert(offsetof(BezierCropVertex, position) == 0, "Unexpected vertex layout");
+static_assert(offsetof(BezierCropVertex, klm) == sizeof(float)*2, "Unexpected vertex layout");
+static_assert(offsetof(BezierCropVertex, morphPosition) == sizeof(float)*5, "Unexpected vertex layout");
+static_assert(offsetof(BezierCropVertex, morphKlm) == sizeof(float)*7, "Unexpected vertex layout");
+static_assert(sizeof(BezierCropVertex) == sizeof(float)*10, "Unexpected vertex layout");
+
+
+
+template<typename V>
+constexpr bool isBezierCropPackable() noexcept {
+	//Vertices must be a tightly packed pos/klm pair of floats. offsetof
+	//is only defined for standard layout types
+	if constexpr (std::is_standard_layout_v<V>) {
+		return 	sizeof(V) == sizeof(Math::Vec2f) + sizeof(Math::Vec3f) &&
+				offsetof(V, pos) == 0 &&
+				offsetof(V, klm) == sizeof(Math::Vec2f) ;
+	} else {
+		return false;
+	}
+}
+
+template<typename V>
+void packBezierCropVerticesGeneric(	BezierCropVertex* dst,
+									const V* source,
+									const V* target,
+									size_t count ) noexcept
+{
+	for(size_t i = 0; i < count; ++i) {
+		dst[i] = BezierCropVertex(
+			source[i].pos,
+			source[i].klm,
+			target[i].pos,
+			target[i].klm
+		);
+	}
+}
+
+//Kernels for the bulk path. Each output vertex is made out of 2 
+//consecutive 5 float chunks, one from the source and one from the target
+constexpr size_t BEZIER_CROP_CHUNK_SIZE = 5;
+
+inline void packBezierCropChunksScalar(	float* d,
+										const float* s,
+										const float* t,
+										size_t count ) noexcept
+{
+	//Fixed size copies are lowered to moves by the compiler
+	constexpr auto CHUNK_SIZE = BEZIER_CROP_CHUNK_SIZE;
+	for(size_t i = 0; i < count; ++i) {
+		std::memcpy(d, s, sizeof(float)*CHUNK_SIZE);
+		std::memcpy(d + CHUNK_SIZE, t, sizeof(float)*CHUNK_SIZE);
+
+		d += 2*CHUNK_SIZE;
+		s += CHUNK_SIZE;
+		t += CHUNK_SIZE;
+	}
+}
+
+#if defined(ZUAZO_BEZIER_CROP_VERTEX_X86)
+
+__attribute__((target("sse2")))
+inline void packBezierCropChunksSse2(	float* d,
+										const float* s,
+										const float* t,
+										size_t count ) noexcept
+{
+	//A 4 float move plus a single float move per 5 float chunk. Unlike
+	//overlapping 4 float moves, this does not stall store forwarding
+	constexpr auto CHUNK_SIZE = BEZIER_CROP_CHUNK_SIZE;
+	for(size_t i = 0; i < count; ++i) {
+		_mm_storeu_ps(d, _mm_loadu_ps(s));
+		_mm_store_ss(d + 4, _mm_load_ss(s + 4));
+		_mm_storeu_ps(d + CHUNK_SIZE, _mm_loadu_ps(t));
+		_mm_store_ss(d + CHUNK_SIZE + 4, _mm_load_ss(t + 4));
+
+		d += 2*CHUNK_SIZE;
+		s += CHUNK_SIZE;
+		t += CHUNK_SIZE;
+	}
+}
+
+__attribute__((target("avx2")))
+inline void packBezierCropChunksAvx2(	float* d,
+										const float* s,
+										const float* t,
+										size_t count ) noexcept
+{
+	//The source chunk and the first 3 floats of the target chunk are 
+	//merged into a single 8 float store. Masked lanes are not accessed,
+	//so reading past the end of the arrays does not fault
+	constexpr auto CHUNK_SIZE = BEZIER_CROP_CHUNK_SIZE;
+	const auto sourceMask = _mm256_setr_epi32(-1, -1, -1, -1, -1, 0, 0, 0);
+	const auto targetMask = _mm256_setr_epi32(-1, -1, -1, 0, 0, 0, 0, 0);
+	const auto targetPermutation = _mm256_setr_epi32(0, 0, 0, 0, 0, 0, 1, 2);
+
+	for(size_t i = 0; i < count; ++i) {
+		const auto head = _mm256_blend_ps(
+			_mm256_maskload_ps(s, sourceMask),
+			_mm256_permutevar8x32_ps(_mm256_maskload_ps(t, targetMask), targetPermutation),
+			0xE0
+		);
+		const auto tail = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(t + 3)));
+		_mm256_storeu_ps(d, head);
+		_mm_store_sd(reinterpret_cast<double*>(d + 8), _mm_castps_pd(tail));
+
+		d += 2*CHUNK_SIZE;
+		s += CHUNK_SIZE;
+		t += CHUNK_SIZE;
+	}
+}
+
+#endif
+
+inline void packBezierCropChunks(	float* d,
+									const float* s,
+									const float* t,
+									size_t count ) noexcept
+{
+#if defined(ZUAZO_BEZIER_CROP_VERTEX_X86)
+	//Select the widest kernel supported by this CPU only once
+	static const bool hasAvx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+
+	if(hasAvx2) {
+		packBezierCropChunksAvx2(d, s, t, count);
+	} else {
+		packBezierCropChunksSse2(d, s, t, count);
+	}
+#else
+	packBezierCropChunksScalar(d, s, t, count);
+#endif
+}
+
+template<typename V>
+void packBezierCropVertices(BezierCropVertex* dst,
+							const V* source,
+							const V* target,
+							size_t count ) noexcept
+{
+	if constexpr (isBezierCropPackable<V>()) {
+		static_assert(sizeof(V) == sizeof(float)*BEZIER_CROP_CHUNK_SIZE, "Unexpected vertex layout");
+		packBezierCropChunks(
+			reinterpret_cast<float*>(dst),
+			reinterpret_cast<const float*>(source),
+			reinterpret_cast<const float*>(target),
+			count
+		);
+	} else {
+		//Layout is not known, use the generic path
+		packBezierCropVerticesGeneric(dst, source, target, count);
+	}
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "PreferredVideoModes.h"
+
+#include <zuazo/Graphics/Uploader.h>
+
+#include <algorithm>
+
+namespace Zuazo::Layers {
+
+std::vector<VideoMode> getPreferredVideoModes(const Instance& instance) {
+	std::vector<VideoMode> result;
+
+	//Split the formats that can be sampled directly into multi-planar 
+	//and packed ones
+	auto formats = Graphics::Uploader::getSupportedFormats(instance.getVulkan());
+	const auto planarEnd = std::stable_partition(
+		formats.begin(), formats.end(),
+		[] (ColorFormat format) -> bool {
+			return getPlaneCount(format) > 1;
+		}
+	);
+	std::vector<ColorFormat> planarFormats(formats.begin(), planarEnd);
+	std::vector<ColorFormat> packedFormats(planarEnd, formats.end());
+
+	//Native YCbCr planar and semi-planar formats come first, as the
+	//color model conversion and chroma upsampling is done when sampling
+	if(!planarFormats.empty()) {
+		result.emplace_back(
+			Utils::Any<Rate>(),
+			instance.getResolutionSupport(),
+			Utils::Any<AspectRatio>(),
+			Utils::Any<ColorPrimaries>(),
+			Utils::Any<ColorModel>(),
+			Utils::Any<ColorTransferFunction>(),
+			Utils::Any<ColorSubsampling>(),
+			Utils::Any<ColorRange>(),
+			std::move(planarFormats)
+		);
+	}
+
+	//Packed formats are also sampled directly
+	if(!packedFormats.empty()) {
+		result.emplace_back(
+			Utils::Any<Rate>(),
+			instance.getResolutionSupport(),
+			Utils::Any<AspectRatio>(),
+			Utils::Any<ColorPrimaries>(),
+			Utils::Any<ColorModel>(),
+			Utils::Any<ColorTransferFunction>(),
+			Utils::Any<ColorSubsampling>(),
+			Utils::Any<ColorRange>(),
+			std::move(packedFormats)
+		);
+	}
+
+	return result;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <zuazo/Instance.h>
+#include <zuazo/VideoMode.h>
+
+#include <vector>
+
+namespace Zuazo::Layers {
+
+//Video modes that frame layers can sample without conversions, ordered by
+//preference. Shared by all the layers which draw frames
+std::vector<VideoMode> getPreferredVideoModes(const Instance& instance);
+
+}
\ No newline at end of file
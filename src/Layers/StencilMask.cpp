@@ -0,0 +1,1015 @@
+#include <zuazo/Layers/StencilMask.h>
+
+#include <zuazo/Utils/StaticId.h>
+#include <zuazo/Utils/Hasher.h>
+#include <zuazo/Utils/Pool.h>
+#include <zuazo/Graphics/StagedBuffer.h>
+#include <zuazo/Graphics/UniformBuffer.h>
+#include <zuazo/Graphics/VulkanConversions.h>
+
+#include <utility>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstring>
+
+namespace Zuazo::Layers {
+
+struct StencilMaskImpl {
+	struct Open {
+		struct ControlPoints {
+			std::array<Math::Vec2f, 4> points;
+		};
+
+		enum ControlPointLayout {
+			CONTROL_POINT_LOCATION_POINTS,
+			CONTROL_POINT_LOCATION_MORPH_POINTS = CONTROL_POINT_LOCATION_POINTS + 4,
+
+			CONTROL_POINT_LOCATION_COUNT = CONTROL_POINT_LOCATION_MORPH_POINTS + 4
+		};
+
+		enum PipelineType {
+			PIPELINE_WINDING,
+			PIPELINE_RESOLVE,
+			PIPELINE_CLEAR,
+
+			PIPELINE_COUNT
+		};
+
+		enum DescriptorSets {
+			DESCRIPTOR_SET_RENDERER = RendererBase::DESCRIPTOR_SET,
+			DESCRIPTOR_SET_STENCILMASK,
+
+			DESCRIPTOR_SET_COUNT
+		};
+
+		enum DescriptorBindings {
+			DESCRIPTOR_BINDING_VERTEXDATA,
+
+			DESCRIPTOR_COUNT
+		};
+
+		//Shares the layout with BezierCrop so that its stencil shader can be used
+		enum VertexDataUniforms {
+			VERTEXDATA_UNIFORM_MODEL_MATRIX,
+			VERTEXDATA_UNIFORM_MORPH_FACTOR,
+			VERTEXDATA_UNIFORM_TEXCOORD_SCALE,
+			VERTEXDATA_UNIFORM_COVER_BOUNDS,
+
+			VERTEXDATA_UNIFORM_COUNT
+		};
+
+		static constexpr std::array<Utils::Area, VERTEXDATA_UNIFORM_COUNT> VERTEXDATA_UNIFORM_LAYOUT = {
+			Utils::Area(0,														sizeof(Math::Mat4x4f)),	//VERTEXDATA_UNIFORM_MODEL_MATRIX
+			Utils::Area(sizeof(Math::Mat4x4f),									sizeof(float)),			//VERTEXDATA_UNIFORM_MORPH_FACTOR
+			Utils::Area(sizeof(Math::Mat4x4f)+sizeof(Math::Vec2f),				sizeof(Math::Vec2f)),	//VERTEXDATA_UNIFORM_TEXCOORD_SCALE
+			Utils::Area(sizeof(Math::Mat4x4f)+sizeof(Math::Vec4f),				sizeof(Math::Vec4f)),	//VERTEXDATA_UNIFORM_COVER_BOUNDS
+		};
+
+		static constexpr uint32_t VERTEX_BUFFER_BINDING = 0;
+		static constexpr uint32_t STENCIL_SUBDIVISIONS = 32;
+		static constexpr uint32_t RESOLVE_VERTEX_COUNT = 4;
+		static constexpr size_t MAX_GEOMETRY_COUNT = 4;
+		static constexpr size_t BUFFER_GROWTH_FACTOR = 2;
+		static constexpr size_t BUFFER_SHRINK_THRESHOLD = 4;
+
+		struct Resources {
+			Resources(	Graphics::UniformBuffer uniformBuffer,
+						vk::UniqueDescriptorPool descriptorPool )
+				: uniformBuffer(std::move(uniformBuffer))
+				, descriptorPool(std::move(descriptorPool))
+			{
+			}
+
+			~Resources() = default;
+
+			Graphics::UniformBuffer								uniformBuffer;
+			vk::UniqueDescriptorPool							descriptorPool;
+		};
+
+		struct Geometry {
+			Geometry()
+				: vertexBuffer()
+				, segmentCount(0)
+			{
+			}
+
+			~Geometry() = default;
+
+			Graphics::StagedBuffer								vertexBuffer;
+			size_t												segmentCount;
+		};
+
+		const Graphics::Vulkan&								vulkan;
+
+		std::shared_ptr<Resources>							resources;
+		vk::DescriptorSet									descriptorSet;
+
+		std::vector<std::shared_ptr<Geometry>>				geometries;
+		size_t												currentGeometry;
+		std::vector<ControlPoints>							controlPoints;
+		bool												flushGeometry;
+
+		vk::PipelineLayout									pipelineLayout;
+		vk::Pipeline										windingPipeline;
+		vk::Pipeline										resolvePipeline;
+		vk::Pipeline										clearPipeline;
+
+		Open(	const Graphics::Vulkan& vulkan,
+				Utils::BufferView<const StencilMask::BezierLoop> crop,
+				const Math::Transformf& transform,
+				vk::RenderPass renderPass,
+				RenderingLayer renderingLayer )
+			: vulkan(vulkan)
+			, resources(Utils::makeShared<Resources>(	createUniformBuffer(vulkan),
+														createDescriptorPool(vulkan) ))
+			, descriptorSet(createDescriptorSet(vulkan, *resources->descriptorPool))
+			, geometries()
+			, currentGeometry(0)
+			, controlPoints()
+			, flushGeometry(false)
+			, pipelineLayout(createPipelineLayout(vulkan))
+			, windingPipeline()
+			, resolvePipeline()
+			, clearPipeline()
+		{
+			resources->uniformBuffer.writeDescirptorSet(vulkan, descriptorSet);
+
+			setCrop(crop);
+			updateModelMatrixUniform(transform);
+			updateMorphFactorUniform(0.0f);
+			recreate(renderPass, renderingLayer);
+		}
+
+		~Open() {
+			for(const auto& geometry : geometries) {
+				geometry->vertexBuffer.waitCompletion(vulkan);
+			}
+			resources->uniformBuffer.waitCompletion(vulkan);
+		}
+
+		void recreate(	vk::RenderPass renderPass,
+						RenderingLayer renderingLayer )
+		{
+			windingPipeline = createPipeline(vulkan, PIPELINE_WINDING, pipelineLayout, renderPass, renderingLayer);
+			resolvePipeline = createPipeline(vulkan, PIPELINE_RESOLVE, pipelineLayout, renderPass, renderingLayer);
+			clearPipeline = createPipeline(vulkan, PIPELINE_CLEAR, pipelineLayout, renderPass, renderingLayer);
+		}
+
+		void draw(Graphics::CommandBuffer& cmd) {
+			assert(resources);
+			assert(windingPipeline);
+			assert(resolvePipeline);
+
+			//Upload the control points if necessary
+			uploadGeometry();
+			const auto geometry = geometries.empty() ? nullptr : geometries[currentGeometry];
+
+			//Flush the unform buffer
+			resources->uniformBuffer.flush(vulkan);
+
+			cmd.bindDescriptorSets(
+				vk::PipelineBindPoint::eGraphics,								//Pipeline bind point
+				pipelineLayout,													//Pipeline layout
+				DESCRIPTOR_SET_STENCILMASK,										//First index
+				descriptorSet,													//Descriptor sets
+				{}																//Dynamic offsets
+			);
+
+			//Accumulate the winding number of the shape. Empty shapes
+			//are still resolved so that everything gets masked out
+			if(geometry && geometry->segmentCount) {
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, windingPipeline);
+
+				cmd.bindVertexBuffers(
+					VERTEX_BUFFER_BINDING,										//Binding
+					geometry->vertexBuffer.getBuffer(),							//Vertex buffers
+					0UL															//Offsets
+				);
+
+				cmd.get().pushConstants(
+					pipelineLayout,												//Pipeline layout
+					vk::ShaderStageFlagBits::eVertex,							//Shader stages
+					0, sizeof(STENCIL_SUBDIVISIONS),							//Offset, size
+					&STENCIL_SUBDIVISIONS										//Data
+				);
+
+				cmd.draw(
+					3*STENCIL_SUBDIVISIONS,										//Vertex count
+					geometry->segmentCount,										//Instance count
+					0,															//First vertex
+					0															//First instance
+				);
+
+				cmd.addDependencies({ geometry });
+			}
+
+			//Flag the pixels outside the shape and clear the winding numbers
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, resolvePipeline);
+			cmd.draw(
+				RESOLVE_VERTEX_COUNT,											//Vertex count
+				1,																//Instance count
+				0,																//First vertex
+				0																//First instance
+			);
+
+			//Add the dependencies to the command buffer
+			cmd.addDependencies({ resources });
+		}
+
+		void drawEnd(Graphics::CommandBuffer& cmd) {
+			assert(clearPipeline);
+
+			//Clear the mask bit, so that the following layers are not clipped
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, clearPipeline);
+			cmd.draw(
+				RESOLVE_VERTEX_COUNT,											//Vertex count
+				1,																//Instance count
+				0,																//First vertex
+				0																//First instance
+			);
+		}
+
+		void setCrop(Utils::BufferView<const StencilMask::BezierLoop> crop) {
+			controlPoints.clear();
+
+			for(const auto& loop : crop) {
+				for(size_t i = 0; i < loop.getSegmentCount(); ++i) {
+					const auto segment = loop.getSegment(i);
+
+					ControlPoints cp;
+					for(size_t j = 0; j < cp.points.size(); ++j) {
+						cp.points[j] = segment[j];
+					}
+
+					controlPoints.push_back(cp);
+				}
+			}
+
+			flushGeometry = true;
+		}
+
+		void updateModelMatrixUniform(const Math::Transformf& transform) {
+			assert(resources);
+			resources->uniformBuffer.waitCompletion(vulkan);
+
+			const auto mtx = transform.calculateMatrix();
+			resources->uniformBuffer.write(
+				vulkan,
+				DESCRIPTOR_BINDING_VERTEXDATA,
+				&mtx,
+				sizeof(mtx),
+				VERTEXDATA_UNIFORM_LAYOUT[VERTEXDATA_UNIFORM_MODEL_MATRIX].offset()
+			);
+		}
+
+	private:
+		void updateMorphFactorUniform(float factor) {
+			assert(resources);
+			resources->uniformBuffer.waitCompletion(vulkan);
+
+			resources->uniformBuffer.write(
+				vulkan,
+				DESCRIPTOR_BINDING_VERTEXDATA,
+				&factor,
+				sizeof(factor),
+				VERTEXDATA_UNIFORM_LAYOUT[VERTEXDATA_UNIFORM_MORPH_FACTOR].offset()
+			);
+		}
+
+		void uploadGeometry() {
+			if(flushGeometry) {
+				//Write into a buffer which is not being drawn
+				const auto next = acquireGeometry();
+				const auto& geometry = geometries[next];
+
+				const auto size = controlPoints.size()*sizeof(ControlPoints);
+				reserveBuffer(vulkan, geometry->vertexBuffer, vk::BufferUsageFlagBits::eVertexBuffer, size);
+				geometry->segmentCount = controlPoints.size();
+
+				if(geometry->segmentCount) {
+					assert(geometry->vertexBuffer.size() >= size);
+					std::memcpy(
+						geometry->vertexBuffer.data(),
+						controlPoints.data(),
+						size
+					);
+
+					geometry->vertexBuffer.flushData(
+						vulkan,
+						vulkan.getTransferQueueIndex(),
+						vk::AccessFlagBits::eVertexAttributeRead,
+						vk::PipelineStageFlagBits::eVertexInput
+					);
+				}
+
+				//Present the new geometry
+				currentGeometry = next;
+				flushGeometry = false;
+			}
+		}
+
+		size_t acquireGeometry() {
+			//Look for buffers which are no longer referenced by a pending 
+			//command buffer, starting from the least recently presented one
+			for(size_t i = 1; i <= geometries.size(); ++i) {
+				const auto index = (currentGeometry + i) % geometries.size();
+				const auto& geometry = geometries[index];
+
+				if(geometry.use_count() == 1) {
+					geometry->vertexBuffer.waitCompletion(vulkan);
+					return index;
+				}
+			}
+
+			//All of them are in flight. Grow the ring, placing the new buffer 
+			//so that it becomes the most recently presented one
+			const auto index = geometries.empty() ? 0 : currentGeometry + 1;
+			if(geometries.size() < MAX_GEOMETRY_COUNT) {
+				geometries.insert(
+					geometries.cbegin() + index, 
+					Utils::makeShared<Geometry>()
+				);
+				return index;
+			}
+
+			//Too many frames in flight. Release the oldest one. Its memory
+			//will be kept alive by the command buffers using it
+			const auto oldest = index % geometries.size();
+			geometries[oldest] = Utils::makeShared<Geometry>();
+			return oldest;
+		}
+
+		static void reserveBuffer(	const Graphics::Vulkan& vulkan,
+									Graphics::StagedBuffer& buffer,
+									vk::BufferUsageFlags usage,
+									size_t size )
+		{
+			//Grow geometrically and only shrink when the usage drops well 
+			//below the capacity, so that small edits never reallocate
+			const auto capacity = buffer.size();
+			if(size > capacity || size < capacity / BUFFER_SHRINK_THRESHOLD) {
+				if(size > 0) {
+					buffer = Graphics::StagedBuffer(
+						vulkan,
+						usage,
+						size * BUFFER_GROWTH_FACTOR
+					);
+				} else {
+					buffer = Graphics::StagedBuffer();
+				}
+			}
+		}
+
+
+		static vk::DescriptorSetLayout getDescriptorSetLayout(	const Graphics::Vulkan& vulkan)
+		{
+			static const Utils::StaticId id;
+			auto result = vulkan.createDescriptorSetLayout(id);
+
+			if(!result) {
+				//Create the bindings
+				const std::array bindings = {
+					vk::DescriptorSetLayoutBinding(	//UBO binding
+						DESCRIPTOR_BINDING_VERTEXDATA,					//Binding
+						vk::DescriptorType::eUniformBuffer,				//Type
+						1,												//Count
+						vk::ShaderStageFlagBits::eVertex,				//Shader stage
+						nullptr											//Immutable samplers
+					),
+				};
+
+				const vk::DescriptorSetLayoutCreateInfo createInfo(
+					{},
+					bindings.size(), bindings.data()
+				);
+
+				result = vulkan.createDescriptorSetLayout(id, createInfo);
+			}
+
+			return result;
+		}
+
+		static Utils::BufferView<const std::pair<uint32_t, size_t>> getUniformBufferSizes() noexcept {
+			static const std::array uniformBufferSizes = {
+				std::make_pair<uint32_t, size_t>(DESCRIPTOR_BINDING_VERTEXDATA,		VERTEXDATA_UNIFORM_LAYOUT.back().end() )
+			};
+
+			return uniformBufferSizes;
+		}
+
+		static Graphics::UniformBuffer createUniformBuffer(const Graphics::Vulkan& vulkan) {
+			return Graphics::UniformBuffer(vulkan, getUniformBufferSizes());
+		}
+
+		static vk::UniqueDescriptorPool createDescriptorPool(const Graphics::Vulkan& vulkan){
+			const std::array poolSizes = {
+				vk::DescriptorPoolSize(
+					vk::DescriptorType::eUniformBuffer,					//Descriptor type
+					getUniformBufferSizes().size()						//Descriptor count
+				)
+			};
+
+			const vk::DescriptorPoolCreateInfo createInfo(
+				{},														//Flags
+				1,														//Descriptor set count
+				poolSizes.size(), poolSizes.data()						//Pool sizes
+			);
+
+			return vulkan.createDescriptorPool(createInfo);
+		}
+
+		static vk::DescriptorSet createDescriptorSet(	const Graphics::Vulkan& vulkan,
+														vk::DescriptorPool pool )
+		{
+			const auto layout = getDescriptorSetLayout(vulkan);
+			return vulkan.allocateDescriptorSet(pool, layout).release();
+		}
+
+		static vk::PipelineLayout createPipelineLayout(const Graphics::Vulkan& vulkan) {
+			static const Utils::StaticId id;
+
+			auto result = vulkan.createPipelineLayout(id);
+			if(!result) {
+				const std::array layouts = {
+					RendererBase::getDescriptorSetLayout(vulkan), 			//DESCRIPTOR_SET_RENDERER
+					getDescriptorSetLayout(vulkan) 							//DESCRIPTOR_SET_STENCILMASK
+				};
+
+				constexpr std::array pushConstants = {
+					vk::PushConstantRange(
+						vk::ShaderStageFlagBits::eVertex,				//Shader stages
+						0, sizeof(STENCIL_SUBDIVISIONS)					//Offset, size (subdivisions)
+					)
+				};
+
+				const vk::PipelineLayoutCreateInfo createInfo(
+					{},													//Flags
+					layouts.size(), layouts.data(),						//Descriptor set layouts
+					pushConstants.size(), pushConstants.data()			//Push constants
+				);
+
+				result = vulkan.createPipelineLayout(id, createInfo);
+			}
+
+			return result;
+		}
+
+		static vk::ShaderModule getShaderModule(const Graphics::Vulkan& vulkan,
+												Utils::BufferView<const uint32_t> code )
+		{
+			//Use the code's address as an identifier
+			const size_t id = reinterpret_cast<uintptr_t>(code.data());
+
+			//Try to retrive modules from cache
+			auto result = vulkan.createShaderModule(id);
+			if(!result) {
+				//Modules isn't in cache. Create it
+				result = vulkan.createShaderModule(id, code);
+			}
+
+			assert(result);
+			return result;
+		}
+
+		static vk::Pipeline createPipeline(	const Graphics::Vulkan& vulkan,
+											PipelineType type,
+											vk::PipelineLayout layout,
+											vk::RenderPass renderPass,
+											RenderingLayer renderingLayer )
+		{
+			using Index = std::tuple<	PipelineType,
+										vk::PipelineLayout,
+										vk::RenderPass,
+										RenderingLayer >;
+			static std::unordered_map<Index, const Utils::StaticId, Utils::Hasher<Index>> ids;
+
+			//Obtain the id related to the configuration
+			Index index(type, layout, renderPass, renderingLayer);
+			const auto& id = ids[index]; //TODO concurrency
+
+			//Try to obtain it from cache
+			auto result = vulkan.createGraphicsPipeline(id);
+			if(!result) {
+				//No luck, we need to create it
+				static //So that its ptr can be used as an identifier
+				#include <bezier_crop_stencil_vert.h>
+				static
+				#include <stencil_mask_vert.h>
+
+				const auto vertexShader = (type == PIPELINE_WINDING) ?
+					getShaderModule(vulkan, bezier_crop_stencil_vert) :
+					getShaderModule(vulkan, stencil_mask_vert) ;
+
+				//Only the stencil is written, so no fragment shader is needed
+				constexpr auto SHADER_ENTRY_POINT = "main";
+				const std::array shaderStages = {
+					vk::PipelineShaderStageCreateInfo(
+						{},												//Flags
+						vk::ShaderStageFlagBits::eVertex,				//Shader type
+						vertexShader,									//Shader handle
+						SHADER_ENTRY_POINT,								//Shader entry point
+						nullptr											//Specialization
+					),
+				};
+
+				//One instance per cubic segment
+				constexpr std::array vertexBindings = {
+					vk::VertexInputBindingDescription(
+						VERTEX_BUFFER_BINDING,
+						sizeof(ControlPoints),
+						vk::VertexInputRate::eInstance
+					)
+				};
+
+				std::array<vk::VertexInputAttributeDescription, CONTROL_POINT_LOCATION_COUNT> vertexAttributes;
+				for(size_t i = 0; i < std::tuple_size<decltype(ControlPoints::points)>::value; ++i) {
+					vertexAttributes[CONTROL_POINT_LOCATION_POINTS + i] = vk::VertexInputAttributeDescription(
+						CONTROL_POINT_LOCATION_POINTS + i,
+						VERTEX_BUFFER_BINDING,
+						vk::Format::eR32G32Sfloat,
+						offsetof(ControlPoints, points) + i*sizeof(Math::Vec2f)
+					);
+
+					//Masks are not morphed. Read the same points for the morph 
+					//target, so that they are only uploaded once
+					vertexAttributes[CONTROL_POINT_LOCATION_MORPH_POINTS + i] = vk::VertexInputAttributeDescription(
+						CONTROL_POINT_LOCATION_MORPH_POINTS + i,
+						VERTEX_BUFFER_BINDING,
+						vk::Format::eR32G32Sfloat,
+						offsetof(ControlPoints, points) + i*sizeof(Math::Vec2f)
+					);
+				}
+
+				vk::PipelineVertexInputStateCreateInfo vertexInput;
+				vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
+				auto depthStencil = Graphics::getDepthStencilConfiguration(renderingLayer);
+				depthStencil.depthTestEnable = false;
+				depthStencil.depthWriteEnable = false;
+				depthStencil.stencilTestEnable = true;
+
+				switch(type) {
+				case PIPELINE_WINDING:
+					vertexInput = vk::PipelineVertexInputStateCreateInfo(
+						{},
+						vertexBindings.size(), vertexBindings.data(),		//Vertex bindings
+						vertexAttributes.size(), vertexAttributes.data()	//Vertex attributes
+					);
+					inputAssembly = vk::PipelineInputAssemblyStateCreateInfo(
+						{},												//Flags
+						vk::PrimitiveTopology::eTriangleList,			//Topology
+						false											//Restart enable
+					);
+
+					//Accumulate the winding number
+					depthStencil.front = vk::StencilOpState(
+						vk::StencilOp::eKeep,							//Fail op
+						vk::StencilOp::eIncrementAndWrap,				//Pass op
+						vk::StencilOp::eKeep,							//Depth fail op
+						vk::CompareOp::eAlways,							//Compare op
+						0, 												//Compare mask
+						StencilMask::STENCIL_WINDING_BITS, 				//Write mask
+						0												//Reference
+					);
+					depthStencil.back = vk::StencilOpState(
+						vk::StencilOp::eKeep,							//Fail op
+						vk::StencilOp::eDecrementAndWrap,				//Pass op
+						vk::StencilOp::eKeep,							//Depth fail op
+						vk::CompareOp::eAlways,							//Compare op
+						0, 												//Compare mask
+						StencilMask::STENCIL_WINDING_BITS, 				//Write mask
+						0												//Reference
+					);
+					break;
+
+				case PIPELINE_RESOLVE:
+					//Vertices are generated on the shader
+					inputAssembly = vk::PipelineInputAssemblyStateCreateInfo(
+						{},												//Flags
+						vk::PrimitiveTopology::eTriangleStrip,			//Topology
+						false											//Restart enable
+					);
+
+					//Pixels with a zero winding number get the mask bit. The
+					//rest are cleared. Note that the reference's winding bits
+					//are zero, so it can be used for both comparing and writing
+					depthStencil.front = vk::StencilOpState(
+						vk::StencilOp::eZero,							//Fail op
+						vk::StencilOp::eReplace,						//Pass op
+						vk::StencilOp::eReplace,						//Depth fail op
+						vk::CompareOp::eEqual,							//Compare op
+						StencilMask::STENCIL_WINDING_BITS, 				//Compare mask
+						StencilMask::STENCIL_MASK_BIT | StencilMask::STENCIL_WINDING_BITS, //Write mask
+						StencilMask::STENCIL_MASK_BIT					//Reference
+					);
+					depthStencil.back = depthStencil.front;
+					break;
+
+				case PIPELINE_CLEAR:
+					inputAssembly = vk::PipelineInputAssemblyStateCreateInfo(
+						{},												//Flags
+						vk::PrimitiveTopology::eTriangleStrip,			//Topology
+						false											//Restart enable
+					);
+
+					//Reset the stencil everywhere
+					depthStencil.front = vk::StencilOpState(
+						vk::StencilOp::eZero,							//Fail op
+						vk::StencilOp::eZero,							//Pass op
+						vk::StencilOp::eZero,							//Depth fail op
+						vk::CompareOp::eAlways,							//Compare op
+						0, 												//Compare mask
+						StencilMask::STENCIL_MASK_BIT | StencilMask::STENCIL_WINDING_BITS, //Write mask
+						0												//Reference
+					);
+					depthStencil.back = depthStencil.front;
+					break;
+				}
+
+				constexpr vk::PipelineViewportStateCreateInfo viewport(
+					{},													//Flags
+					1, nullptr,											//Viewports (dynamic)
+					1, nullptr											//Scissors (dynamic)
+				);
+
+				constexpr vk::PipelineRasterizationStateCreateInfo rasterizer(
+					{},													//Flags
+					false, 												//Depth clamp enabled
+					false,												//Rasterizer discard enable
+					vk::PolygonMode::eFill,								//Polygon mode
+					vk::CullModeFlagBits::eNone, 						//Cull faces
+					vk::FrontFace::eClockwise,							//Front face direction
+					false, 0.0f, 0.0f, 0.0f,							//Depth bias
+					1.0f												//Line width
+				);
+
+				constexpr vk::PipelineMultisampleStateCreateInfo multisample(
+					{},													//Flags
+					vk::SampleCountFlagBits::e1,						//Sample count
+					false, 1.0f,										//Sample shading enable, min sample shading
+					nullptr,											//Sample mask
+					false, false										//Alpha to coverage, alpha to 1 enable
+				);
+
+				//Color is left untouched
+				const std::array colorBlendAttachments = {
+					vk::PipelineColorBlendAttachmentState()
+				};
+
+				const vk::PipelineColorBlendStateCreateInfo colorBlend(
+					{},													//Flags
+					false,												//Enable logic operation
+					vk::LogicOp::eCopy,									//Logic operation
+					colorBlendAttachments.size(), colorBlendAttachments.data() //Blend attachments
+				);
+
+				constexpr std::array dynamicStates = {
+					vk::DynamicState::eViewport,
+					vk::DynamicState::eScissor
+				};
+
+				const vk::PipelineDynamicStateCreateInfo dynamicState(
+					{},													//Flags
+					dynamicStates.size(), dynamicStates.data()			//Dynamic states
+				);
+
+				const vk::GraphicsPipelineCreateInfo createInfo(
+					{},													//Flags
+					shaderStages.size(), shaderStages.data(),			//Shader stages
+					&vertexInput,										//Vertex input
+					&inputAssembly,										//Vertex assembly
+					nullptr,											//Tesselation
+					&viewport,											//Viewports
+					&rasterizer,										//Rasterizer
+					&multisample,										//Multisampling
+					&depthStencil,										//Depth / Stencil tests
+					&colorBlend,										//Color blending
+					&dynamicState,										//Dynamic states
+					layout,												//Pipeline layout
+					renderPass, 0,										//Renderpasses
+					nullptr, 0											//Inherit
+				);
+
+				result = vulkan.createGraphicsPipeline(id, createInfo);
+			}
+
+			assert(result);
+			return result;
+		}
+
+	};
+
+	class EndLayer : public LayerBase {
+	public:
+		EndLayer(StencilMaskImpl& mask)
+			: LayerBase(
+				[] (LayerBase&, const Math::Transformf&) {},
+				[] (LayerBase&, float) {},
+				[] (LayerBase&, BlendingMode) {},
+				[] (LayerBase&, RenderingLayer) {},
+				std::bind(&StencilMaskImpl::endHasChangedCallback, std::ref(mask), std::placeholders::_1, std::placeholders::_2),
+				[] (const LayerBase&) -> bool { return true; },
+				std::bind(&StencilMaskImpl::endDrawCallback, std::ref(mask), std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+				[] (LayerBase&, vk::RenderPass) {} )
+		{
+		}
+
+		~EndLayer() = default;
+	};
+
+	using LastRenderers = std::unordered_set<const RendererBase*>;
+
+	std::reference_wrapper<StencilMask>		owner;
+
+	std::vector<StencilMask::BezierLoop>	crop;
+	EndLayer								endLayer;
+
+	std::unique_ptr<Open>					opened;
+	LastRenderers							lastRenderers;
+	LastRenderers							endLastRenderers;
+
+
+	StencilMaskImpl(StencilMask& owner,
+					Utils::BufferView<const StencilMask::BezierLoop> crop )
+		: owner(owner)
+		, crop(crop.cbegin(), crop.cend())
+		, endLayer(*this)
+	{
+	}
+
+	~StencilMaskImpl() = default;
+
+	void moved(ZuazoBase& base) {
+		owner = static_cast<StencilMask&>(base);
+	}
+
+	void open(ZuazoBase& base, std::unique_lock<Instance>* lock = nullptr) {
+		auto& stencilMask = static_cast<StencilMask&>(base);
+		assert(&owner.get() == &stencilMask);
+		assert(!opened);
+
+		if(stencilMask.getRenderPass()) {
+			//Create in a unlocked environment
+			if(lock) lock->unlock();
+			auto newOpened = Utils::makeUnique<Open>(
+					stencilMask.getInstance().getVulkan(),
+					getCrop(),
+					stencilMask.getTransform(),
+					stencilMask.getRenderPass(),
+					stencilMask.getRenderingLayer()
+			);
+			if(lock) lock->lock();
+
+			//Write changes after locking back
+			opened = std::move(newOpened);
+		}
+
+		assert(lastRenderers.empty()); //Any hasChanged() should return true
+	}
+
+	void asyncOpen(ZuazoBase& base, std::unique_lock<Instance>& lock) {
+		assert(lock.owns_lock());
+		open(base, &lock);
+		assert(lock.owns_lock());
+	}
+
+
+	void close(ZuazoBase& base, std::unique_lock<Instance>* lock = nullptr) {
+		auto& stencilMask = static_cast<StencilMask&>(base);
+		assert(&owner.get() == &stencilMask); (void)(stencilMask);
+
+		//Write changes
+		lastRenderers.clear();
+		endLastRenderers.clear();
+		auto oldOpened = std::move(opened);
+
+		//Destroy the object in a unlocked environment
+		if(oldOpened) {
+			if(lock) lock->unlock();
+			oldOpened.reset();
+			if(lock) lock->lock();
+		}
+
+		assert(!opened);
+	}
+
+	void asyncClose(ZuazoBase& base, std::unique_lock<Instance>& lock) {
+		assert(lock.owns_lock());
+		close(base, &lock);
+		assert(lock.owns_lock());
+	}
+
+	bool hasChangedCallback(const LayerBase& base, const RendererBase& renderer) const {
+		const auto& stencilMask = static_cast<const StencilMask&>(base);
+		assert(&owner.get() == &stencilMask); (void)(stencilMask);
+
+		//Only changes if it has not been drawn yet by this renderer
+		return lastRenderers.find(&renderer) == lastRenderers.cend();
+	}
+
+	bool hasAlphaCallback(const LayerBase& base) const noexcept {
+		const auto& stencilMask = static_cast<const StencilMask&>(base);
+		assert(&owner.get() == &stencilMask); (void)(stencilMask);
+
+		//Masks affect the subsequent layers, so they should
+		//never be reordered as an opaque layer would
+		return true;
+	}
+
+	void drawCallback(const LayerBase& base, const RendererBase& renderer, Graphics::CommandBuffer& cmd) {
+		const auto& stencilMask = static_cast<const StencilMask&>(base);
+		assert(&owner.get() == &stencilMask); (void)(stencilMask);
+
+		if(opened) {
+			opened->draw(cmd);
+
+			//Update the state for next hasChanged()
+			lastRenderers.insert(&renderer);
+		}
+	}
+
+	bool endHasChangedCallback(const LayerBase& base, const RendererBase& renderer) const {
+		assert(&endLayer == &base); (void)(base);
+		return endLastRenderers.find(&renderer) == endLastRenderers.cend();
+	}
+
+	void endDrawCallback(const LayerBase& base, const RendererBase& renderer, Graphics::CommandBuffer& cmd) {
+		assert(&endLayer == &base); (void)(base);
+
+		//Pipelines are shared with the mask, so both must be 
+		//drawn by the same renderer
+		if(opened) {
+			opened->drawEnd(cmd);
+			endLastRenderers.insert(&renderer);
+		}
+	}
+
+	void transformCallback(LayerBase& base, const Math::Transformf& transform) {
+		auto& stencilMask = static_cast<StencilMask&>(base);
+		assert(&owner.get() == &stencilMask); (void)(stencilMask);
+
+		if(opened) {
+			opened->updateModelMatrixUniform(transform);
+		}
+
+		lastRenderers.clear(); //Will force hasChanged() to true
+	}
+
+	void opacityCallback(LayerBase& base, float) {
+		auto& stencilMask = static_cast<StencilMask&>(base);
+		assert(&owner.get() == &stencilMask); (void)(stencilMask);
+		//Opacity has no effect on a mask
+	}
+
+	void blendingModeCallback(LayerBase& base, BlendingMode) {
+		auto& stencilMask = static_cast<StencilMask&>(base);
+		assert(&owner.get() == &stencilMask); (void)(stencilMask);
+		//Blending has no effect on a mask
+	}
+
+	void renderingLayerCallback(LayerBase& base, RenderingLayer renderingLayer) {
+		auto& stencilMask = static_cast<StencilMask&>(base);
+		recreateCallback(stencilMask, stencilMask.getRenderPass(), renderingLayer);
+	}
+
+	void renderPassCallback(LayerBase& base, vk::RenderPass renderPass) {
+		auto& stencilMask = static_cast<StencilMask&>(base);
+		recreateCallback(stencilMask, renderPass, stencilMask.getRenderingLayer());
+	}
+
+
+	void setCrop(Utils::BufferView<const StencilMask::BezierLoop> crop) {
+		this->crop.clear();
+		this->crop.insert(this->crop.cend(), crop.cbegin(), crop.cend());
+
+		if(opened) {
+			opened->setCrop(this->crop);
+		}
+
+		lastRenderers.clear(); //Will force hasChanged() to true
+	}
+
+	Utils::BufferView<const StencilMask::BezierLoop> getCrop() const {
+		return crop;
+	}
+
+
+	LayerBase& getEndLayer() {
+		return endLayer;
+	}
+
+	const LayerBase& getEndLayer() const {
+		return endLayer;
+	}
+
+private:
+	void recreateCallback(	StencilMask& stencilMask,
+							vk::RenderPass renderPass,
+							RenderingLayer renderingLayer )
+	{
+		assert(&owner.get() == &stencilMask);
+
+		if(stencilMask.isOpen()) {
+			const bool isValid = static_cast<bool>(renderPass);
+
+			if(opened && isValid) {
+				//It remains valid
+				opened->recreate(renderPass, renderingLayer);
+			} else if(opened && !isValid) {
+				//It has become invalid
+				opened.reset();
+			} else if(!opened && isValid) {
+				//It has become valid
+				open(stencilMask, nullptr);
+			}
+
+			lastRenderers.clear(); //Will force hasChanged() to true
+			endLastRenderers.clear();
+		}
+	}
+
+};
+
+
+
+
+StencilMask::StencilMask(	Instance& instance,
+							std::string name,
+							Utils::BufferView<const BezierLoop> crop )
+	: Utils::Pimpl<StencilMaskImpl>({}, *this, crop)
+	, ZuazoBase(
+		instance,
+		std::move(name),
+		{},
+		std::bind(&StencilMaskImpl::moved, std::ref(**this), std::placeholders::_1),
+		std::bind(&StencilMaskImpl::open, std::ref(**this), std::placeholders::_1, nullptr),
+		std::bind(&StencilMaskImpl::asyncOpen, std::ref(**this), std::placeholders::_1, std::placeholders::_2),
+		std::bind(&StencilMaskImpl::close, std::ref(**this), std::placeholders::_1, nullptr),
+		std::bind(&StencilMaskImpl::asyncClose, std::ref(**this), std::placeholders::_1, std::placeholders::_2) )
+	, LayerBase(
+		std::bind(&StencilMaskImpl::transformCallback, std::ref(**this), std::placeholders::_1, std::placeholders::_2),
+		std::bind(&StencilMaskImpl::opacityCallback, std::ref(**this), std::placeholders::_1, std::placeholders::_2),
+		std::bind(&StencilMaskImpl::blendingModeCallback, std::ref(**this), std::placeholders::_1, std::placeholders::_2),
+		std::bind(&StencilMaskImpl::renderingLayerCallback, std::ref(**this), std::placeholders::_1, std::placeholders::_2),
+		std::bind(&StencilMaskImpl::hasChangedCallback, std::ref(**this), std::placeholders::_1, std::placeholders::_2),
+		std::bind(&StencilMaskImpl::hasAlphaCallback, std::ref(**this), std::placeholders::_1),
+		std::bind(&StencilMaskImpl::drawCallback, std::ref(**this), std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+		std::bind(&StencilMaskImpl::renderPassCallback, std::ref(**this), std::placeholders::_1, std::placeholders::_2) )
+{
+}
+
+StencilMask::StencilMask(StencilMask&& other) = default;
+
+StencilMask::~StencilMask() = default;
+
+StencilMask& StencilMask::operator=(StencilMask&& other) = default;
+
+
+void StencilMask::setCrop(Utils::BufferView<const BezierLoop> crop) {
+	(*this)->setCrop(crop);
+}
+
+Utils::BufferView<const StencilMask::BezierLoop> StencilMask::getCrop() const {
+	return (*this)->getCrop();
+}
+
+
+LayerBase& StencilMask::getEndLayer() {
+	return (*this)->getEndLayer();
+}
+
+const LayerBase& StencilMask::getEndLayer() const {
+	return (*this)->getEndLayer();
+}
+
+bool StencilMask::isEndLayer(const LayerBase& layer) noexcept {
+	return dynamic_cast<const StencilMaskImpl::EndLayer*>(&layer);
+}
+
+
+vk::StencilOpState StencilMask::getStencilTestConfiguration() noexcept {
+	//Pass where the mask bit is not set. Never write
+	return vk::StencilOpState(
+		vk::StencilOp::eKeep,											//Fail op
+		vk::StencilOp::eKeep,											//Pass op
+		vk::StencilOp::eKeep,											//Depth fail op
+		vk::CompareOp::eEqual,											//Compare op
+		STENCIL_MASK_BIT,												//Compare mask
+		0,																//Write mask
+		0																//Reference
+	);
+}
+
+bool StencilMask::hasStencilComponent(DepthStencilFormat format) noexcept {
+	switch(Graphics::toVulkan(format)) {
+	case vk::Format::eS8Uint:
+	case vk::Format::eD16UnormS8Uint:
+	case vk::Format::eD24UnormS8Uint:
+	case vk::Format::eD32SfloatS8Uint:
+		return true;
+	default:
+		return false;
+	}
+}
+
+}
\ No newline at end of file
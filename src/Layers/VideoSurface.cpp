@@ -1,4 +1,8 @@
 #include <zuazo/Layers/VideoSurface.h>
+#include <zuazo/Layers/StencilMask.h>
+#include <zuazo/Renderers/Compositor.h>
+
+#include "PreferredVideoModes.h"
 
 #include <zuazo/Signal/Input.h>
 #include <zuazo/Signal/Output.h>
@@ -12,7 +16,12 @@
 
 #include <utility>
 #include <memory>
+#include <optional>
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
 namespace Zuazo::Layers {
 
@@ -24,12 +33,15 @@ struct VideoSurfaceImpl {
 		};
 
 		struct FragmentSpecializationConstants {
-			FragmentSpecializationConstants(uint32_t sampleMode = -1)
+			FragmentSpecializationConstants(uint32_t sampleMode = -1,
+											uint32_t shape = -1 )
 				: sampleMode(sampleMode)
+				, shape(shape)
 			{
 			}
 
 			uint32_t sampleMode;
+			uint32_t shape;
 		};
 
 		enum VertexLayout {
@@ -50,18 +62,43 @@ struct VideoSurfaceImpl {
 		enum DescriptorBindings {
 			DESCRIPTOR_BINDING_MODEL_MATRIX,
 			DESCRIPTOR_BINDING_LAYERDATA,
+			DESCRIPTOR_BINDING_ANIMATION,
 
 			DESCRIPTOR_COUNT
 		};
 
 		enum LayerDataUniforms {
 			LAYERDATA_UNIFORM_OPACITY,
+			LAYERDATA_UNIFORM_CORNER_RADIUS,
+			LAYERDATA_UNIFORM_SHAPE_CENTER,
+			LAYERDATA_UNIFORM_SHAPE_HALF_SIZE,
 
 			LAYERDATA_UNIFORM_COUNT
 		};
 
 		static constexpr std::array<Utils::Area, LAYERDATA_UNIFORM_COUNT> LAYERDATA_UNIFORM_LAYOUT = {
-			Utils::Area(0, 	sizeof(float)  	)	//LAYERDATA_UNIFORM_OPACITY
+			Utils::Area(0, 	sizeof(float)  	),	//LAYERDATA_UNIFORM_OPACITY
+			Utils::Area(4, 	sizeof(float)  	),	//LAYERDATA_UNIFORM_CORNER_RADIUS
+			Utils::Area(8, 	sizeof(Math::Vec2f)	),	//LAYERDATA_UNIFORM_SHAPE_CENTER
+			Utils::Area(16,	sizeof(Math::Vec2f)	)	//LAYERDATA_UNIFORM_SHAPE_HALF_SIZE
+		};
+
+		struct KeyframeData {
+			Math::Vec4f positionTime;
+			Math::Vec4f scaleRotationOpacity;
+			Math::Vec4f easing;
+		};
+
+		enum AnimationUniforms {
+			ANIMATION_UNIFORM_KEYFRAME_COUNT,
+			ANIMATION_UNIFORM_KEYFRAMES,
+
+			ANIMATION_UNIFORM_COUNT
+		};
+
+		static constexpr std::array<Utils::Area, ANIMATION_UNIFORM_COUNT> ANIMATION_UNIFORM_LAYOUT = {
+			Utils::Area(0, 	sizeof(uint32_t)	),											//ANIMATION_UNIFORM_KEYFRAME_COUNT
+			Utils::Area(16,	sizeof(KeyframeData) * VideoSurface::MAX_KEYFRAME_COUNT	)		//ANIMATION_UNIFORM_KEYFRAMES
 		};
 
 		static constexpr uint32_t VERTEX_BUFFER_BINDING = 0;
@@ -83,12 +120,21 @@ struct VideoSurfaceImpl {
 			vk::UniqueDescriptorPool							descriptorPool;
 		};
 
+		struct ShapeBounds {
+			Math::Vec2f											center;
+			Math::Vec2f											halfSize;
+		};
+
 		const Graphics::Vulkan&								vulkan;
 
 		std::shared_ptr<Resources>							resources;
 		Graphics::Frame::Geometry							geometry;
 		vk::DescriptorSet									descriptorSet;
 		FragmentSpecializationConstants						fragmentSpec;
+		std::optional<Math::Mat4x4f>						pendingModelMatrix;
+		std::optional<float>								pendingOpacity;
+		std::optional<float>								pendingCornerRadius;
+		std::optional<ShapeBounds>							pendingShapeBounds;
 
 		vk::DescriptorSetLayout								frameDescriptorSetLayout;
 		vk::PipelineLayout									pipelineLayout;
@@ -98,14 +144,21 @@ struct VideoSurfaceImpl {
 				Math::Vec2f size,
 				ScalingMode scalingMode,
 				const Math::Transformf& transform,
-				float opacity ) 
+				float opacity,
+				Utils::BufferView<const VideoSurface::Keyframe> keyframes,
+				VideoSurface::Shape shape,
+				float cornerRadius ) 
 			: vulkan(vulkan)
 			, resources(Utils::makeShared<Resources>(	createVertexBuffer(vulkan),
 														createUniformBuffer(vulkan),
 														createDescriptorPool(vulkan) ))
 			, geometry(scalingMode, size)
 			, descriptorSet(createDescriptorSet(vulkan, *resources->descriptorPool))
-			, fragmentSpec()
+			, fragmentSpec(-1, static_cast<uint32_t>(shape))
+			, pendingModelMatrix()
+			, pendingOpacity()
+			, pendingCornerRadius()
+			, pendingShapeBounds()
 			, frameDescriptorSetLayout()
 			, pipelineLayout()
 			, pipeline()
@@ -113,6 +166,8 @@ struct VideoSurfaceImpl {
 			resources->uniformBuffer.writeDescirptorSet(vulkan, descriptorSet);
 			updateModelMatrixUniform(transform);
 			updateOpacityUniform(opacity);
+			updateAnimationUniform(keyframes);
+			updateCornerRadiusUniform(cornerRadius);
 		}
 
 		~Open() {
@@ -126,12 +181,18 @@ struct VideoSurfaceImpl {
 			frameDescriptorSetLayout = nullptr;
 		}
 
+		void setShape(VideoSurface::Shape shape) {
+			fragmentSpec.shape = static_cast<uint32_t>(shape);
+			recreate();
+		}
+
 		void draw(	Graphics::CommandBuffer& cmd, 
 					const Video& frame, 
 					ScalingFilter filter,
 					vk::RenderPass renderPass,
 					BlendingMode blendingMode,
-					RenderingLayer renderingLayer ) 
+					RenderingLayer renderingLayer,
+					float animationTime ) 
 		{				
 			assert(resources);			
 			assert(frame);
@@ -156,9 +217,14 @@ struct VideoSurfaceImpl {
 					vk::AccessFlagBits::eVertexAttributeRead,
 					vk::PipelineStageFlagBits::eVertexInput
 				);
+
+				//The shape is fitted to the quad, which may be smaller
+				//than the layer when letterboxing
+				updateShapeBoundsUniform(reinterpret_cast<const Vertex*>(resources->vertexBuffer.data()));
 			}
 
 			//Flush the unform buffer
+			writePendingUniforms();
 			resources->uniformBuffer.flush(vulkan);
 
 			//Configure the sampler for propper operation
@@ -191,6 +257,13 @@ struct VideoSurfaceImpl {
 				filter															//Filter
 			);
 
+			cmd.get().pushConstants(
+				pipelineLayout,													//Pipeline layout
+				vk::ShaderStageFlagBits::eVertex,								//Shader stages
+				0, sizeof(animationTime),										//Offset, size
+				&animationTime													//Data
+			);
+
 			//Draw the frame and finish recording
 			cmd.draw(
 				Graphics::Frame::Geometry::VERTEX_COUNT, 						//Vertex count
@@ -204,32 +277,137 @@ struct VideoSurfaceImpl {
 		}
 
 		void updateModelMatrixUniform(const Math::Transformf& transform) {
+			//Written on the next draw, so that frequent changes coalesce
+			pendingModelMatrix = transform.calculateMatrix();
+		}
+
+		void updateOpacityUniform(float opa) {
+			//Written on the next draw, so that frequent changes coalesce
+			pendingOpacity = opa;
+		}
+
+		void writePendingUniforms() {
+			assert(resources);
+
+			//All of them are written at once, waiting a single time for
+			//the buffer to become available
+			if(pendingModelMatrix || pendingOpacity || pendingCornerRadius || pendingShapeBounds) {
+				resources->uniformBuffer.waitCompletion(vulkan);
+
+				if(pendingModelMatrix) {
+					resources->uniformBuffer.write(
+						vulkan,
+						DESCRIPTOR_BINDING_MODEL_MATRIX,
+						&(*pendingModelMatrix),
+						sizeof(*pendingModelMatrix)
+					);
+				}
+
+				if(pendingOpacity) {
+					resources->uniformBuffer.write(
+						vulkan,
+						DESCRIPTOR_BINDING_LAYERDATA,
+						&(*pendingOpacity),
+						sizeof(*pendingOpacity),
+						LAYERDATA_UNIFORM_LAYOUT[LAYERDATA_UNIFORM_OPACITY].offset()
+					);
+				}
+
+				if(pendingCornerRadius) {
+					resources->uniformBuffer.write(
+						vulkan,
+						DESCRIPTOR_BINDING_LAYERDATA,
+						&(*pendingCornerRadius),
+						sizeof(*pendingCornerRadius),
+						LAYERDATA_UNIFORM_LAYOUT[LAYERDATA_UNIFORM_CORNER_RADIUS].offset()
+					);
+				}
+
+				if(pendingShapeBounds) {
+					resources->uniformBuffer.write(
+						vulkan,
+						DESCRIPTOR_BINDING_LAYERDATA,
+						&(pendingShapeBounds->center),
+						sizeof(pendingShapeBounds->center),
+						LAYERDATA_UNIFORM_LAYOUT[LAYERDATA_UNIFORM_SHAPE_CENTER].offset()
+					);
+
+					resources->uniformBuffer.write(
+						vulkan,
+						DESCRIPTOR_BINDING_LAYERDATA,
+						&(pendingShapeBounds->halfSize),
+						sizeof(pendingShapeBounds->halfSize),
+						LAYERDATA_UNIFORM_LAYOUT[LAYERDATA_UNIFORM_SHAPE_HALF_SIZE].offset()
+					);
+				}
+
+				pendingModelMatrix.reset();
+				pendingOpacity.reset();
+				pendingCornerRadius.reset();
+				pendingShapeBounds.reset();
+			}
+		}
+
+		void updateCornerRadiusUniform(float radius) {
+			//Written on the next draw, so that frequent changes coalesce
+			pendingCornerRadius = radius;
+		}
+
+		void updateAnimationUniform(Utils::BufferView<const VideoSurface::Keyframe> keyframes) {
 			assert(resources);
 			resources->uniformBuffer.waitCompletion(vulkan);
 
-			const auto mtx = transform.calculateMatrix();
+			//Convert the keyframes into the shader layout
+			std::array<KeyframeData, VideoSurface::MAX_KEYFRAME_COUNT> keyframeData;
+			const uint32_t keyframeCount = std::min(keyframes.size(), keyframeData.size());
+			for(size_t i = 0; i < keyframeCount; ++i) {
+				const auto& keyframe = keyframes[i];
+				keyframeData[i] = KeyframeData {
+					Math::Vec4f(keyframe.position, toSeconds(keyframe.time)),
+					Math::Vec4f(keyframe.scale, keyframe.rotation, keyframe.opacity),
+					keyframe.easing
+				};
+			}
+
 			resources->uniformBuffer.write(
 				vulkan,
-				DESCRIPTOR_BINDING_MODEL_MATRIX,
-				&mtx,
-				sizeof(mtx)
+				DESCRIPTOR_BINDING_ANIMATION,
+				&keyframeCount,
+				sizeof(keyframeCount),
+				ANIMATION_UNIFORM_LAYOUT[ANIMATION_UNIFORM_KEYFRAME_COUNT].offset()
 			);
-		}
-
-		void updateOpacityUniform(float opa) {
-			assert(resources);
-			resources->uniformBuffer.waitCompletion(vulkan);			
 
 			resources->uniformBuffer.write(
 				vulkan,
-				DESCRIPTOR_BINDING_LAYERDATA,
-				&opa,
-				sizeof(opa),
-				LAYERDATA_UNIFORM_LAYOUT[LAYERDATA_UNIFORM_OPACITY].offset()
+				DESCRIPTOR_BINDING_ANIMATION,
+				keyframeData.data(),
+				keyframeCount * sizeof(KeyframeData),
+				ANIMATION_UNIFORM_LAYOUT[ANIMATION_UNIFORM_KEYFRAMES].offset()
 			);
 		}
 
+		static float toSeconds(Duration duration) noexcept {
+			return std::chrono::duration_cast<std::chrono::duration<float>>(duration).count();
+		}
+
 	private:
+		void updateShapeBoundsUniform(const Vertex* vertices) {
+			Math::Vec2f min(std::numeric_limits<float>::max());
+			Math::Vec2f max(std::numeric_limits<float>::lowest());
+			for(size_t i = 0; i < Graphics::Frame::Geometry::VERTEX_COUNT; ++i) {
+				min.x = std::min(min.x, vertices[i].position.x);
+				min.y = std::min(min.y, vertices[i].position.y);
+				max.x = std::max(max.x, vertices[i].position.x);
+				max.y = std::max(max.y, vertices[i].position.y);
+			}
+
+			//Written along with the rest of pending uniforms
+			pendingShapeBounds = ShapeBounds {
+				(min + max) / 2.0f,
+				(max - min) / 2.0f
+			};
+		}
+
 		void configureSampler(	const Graphics::Frame& frame, 
 								ScalingFilter filter,
 								vk::RenderPass renderPass,
@@ -282,6 +460,13 @@ struct VideoSurfaceImpl {
 						vk::ShaderStageFlagBits::eFragment,				//Shader stage
 						nullptr											//Immutable samplers
 					), 
+					vk::DescriptorSetLayoutBinding(	//UBO binding
+						DESCRIPTOR_BINDING_ANIMATION,					//Binding
+						vk::DescriptorType::eUniformBuffer,				//Type
+						1,												//Count
+						vk::ShaderStageFlagBits::eVertex,				//Shader stage
+						nullptr											//Immutable samplers
+					), 
 				};
 
 				const vk::DescriptorSetLayoutCreateInfo createInfo(
@@ -298,7 +483,8 @@ struct VideoSurfaceImpl {
 		static Utils::BufferView<const std::pair<uint32_t, size_t>> getUniformBufferSizes() noexcept {
 			static const std::array uniformBufferSizes = {
 				std::make_pair<uint32_t, size_t>(DESCRIPTOR_BINDING_MODEL_MATRIX, 	sizeof(Math::Mat4x4f) ),
-				std::make_pair<uint32_t, size_t>(DESCRIPTOR_BINDING_LAYERDATA,		LAYERDATA_UNIFORM_LAYOUT.back().end() )
+				std::make_pair<uint32_t, size_t>(DESCRIPTOR_BINDING_LAYERDATA,		LAYERDATA_UNIFORM_LAYOUT.back().end() ),
+				std::make_pair<uint32_t, size_t>(DESCRIPTOR_BINDING_ANIMATION,		ANIMATION_UNIFORM_LAYOUT.back().end() )
 			};
 
 			return uniformBufferSizes;
@@ -346,10 +532,17 @@ struct VideoSurfaceImpl {
 					frameDescriptorSetLayout 								//DESCRIPTOR_SET_FRAME
 				};
 
+				constexpr std::array pushConstants = {
+					vk::PushConstantRange(
+						vk::ShaderStageFlagBits::eVertex,				//Shader stages
+						0, sizeof(float)								//Offset, size (animation time)
+					)
+				};
+
 				const vk::PipelineLayoutCreateInfo createInfo(
 					{},													//Flags
 					layouts.size(), layouts.data(),						//Descriptor set layouts
-					0, nullptr											//Push constants
+					pushConstants.size(), pushConstants.data()			//Push constants
 				);
 
 				result = vulkan.createPipelineLayout(id, createInfo);
@@ -410,12 +603,17 @@ struct VideoSurfaceImpl {
 				assert(fragmentShader);
 
 				//Specialization info
-				constexpr std::array<vk::SpecializationMapEntry, 1> fragmentShaderSpecializationMap = {
+				constexpr std::array<vk::SpecializationMapEntry, 2> fragmentShaderSpecializationMap = {
 					vk::SpecializationMapEntry(
 						0,
 						offsetof(FragmentSpecializationConstants, sampleMode),
 						sizeof(FragmentSpecializationConstants::sampleMode)
 					),
+					vk::SpecializationMapEntry(
+						1,
+						offsetof(FragmentSpecializationConstants, shape),
+						sizeof(FragmentSpecializationConstants::shape)
+					),
 				};
 
 				const vk::SpecializationInfo fragmentShaderSpecializationInfo(
@@ -501,7 +699,11 @@ struct VideoSurfaceImpl {
 					false, false										//Alpha to coverage, alpha to 1 enable
 				);
 
-				const auto depthStencil = Graphics::getDepthStencilConfiguration(renderingLayer);
+				//Only draw outside the masked region, if any
+				auto depthStencil = Graphics::getDepthStencilConfiguration(renderingLayer);
+				depthStencil.stencilTestEnable = true;
+				depthStencil.front = StencilMask::getStencilTestConfiguration();
+				depthStencil.back = depthStencil.front;
 
 				const std::array colorBlendAttachments = {
 					Graphics::getBlendingConfiguration(blendingMode)
@@ -552,21 +754,44 @@ struct VideoSurfaceImpl {
 
 	using Input = Signal::Input<Video>;
 	using LastFrames = std::unordered_map<const RendererBase*, Video>;
+	using LastAnimationTimes = std::unordered_map<const RendererBase*, float>;
+	using ProjectedSizes = std::unordered_map<const RendererBase*, Math::Vec2f>;
+
+	static constexpr float PROJECTED_SIZE_HEADROOM = 1.25f; //Margin added to the notified size
+	static constexpr float PROJECTED_SIZE_SHRINK_RATIO = 0.5f; //Relative size needed to notify a smaller size
 
 	std::reference_wrapper<VideoSurface>	owner;
 
 	Input									videoIn;
 
 	Math::Vec2f								size;
+	std::vector<VideoSurface::Keyframe>		animation;
+	TimePoint								animationStartTime;
+	bool									animationLoop;
+	VideoSurface::Shape						shape;
+	float									cornerRadius;
 
 	std::unique_ptr<Open>					opened;
 	LastFrames								lastFrames;
+	LastAnimationTimes						lastAnimationTimes;
+
+	VideoSurface::ProjectedSizeCallback		projectedSizeCallback;
+	ProjectedSizes							projectedSizes;
+	Resolution								projectedSize;
 	
 
 	VideoSurfaceImpl(VideoSurface& owner, Math::Vec2f size)
 		: owner(owner)
 		, videoIn(owner, std::string(Signal::makeInputName<Video>()))
 		, size(size)
+		, animation()
+		, animationStartTime()
+		, animationLoop(false)
+		, shape(VideoSurface::Shape::rectangle)
+		, cornerRadius(0)
+		, projectedSizeCallback()
+		, projectedSizes()
+		, projectedSize(0, 0)
 	{
 	}
 
@@ -590,7 +815,10 @@ struct VideoSurfaceImpl {
 					getSize(),
 					videoSurface.getScalingMode(),
 					videoSurface.getTransform(),
-					videoSurface.getOpacity()
+					videoSurface.getOpacity(),
+					animation,
+					shape,
+					cornerRadius
 			);
 			if(lock) lock->lock();
 
@@ -615,6 +843,8 @@ struct VideoSurfaceImpl {
 		//Write changes
 		videoIn.reset();
 		lastFrames.clear();
+		projectedSizes.clear();
+		notifyProjectedSize();
 		auto oldOpened = std::move(opened);
 
 		//Reset in a unlocked environment
@@ -649,6 +879,12 @@ struct VideoSurfaceImpl {
 		} else if(videoIn.hasChanged()) {
 			//A new frame is available
 			result = true;
+		} else if(const auto animationIte = lastAnimationTimes.find(&renderer); animationIte == lastAnimationTimes.cend()) {
+			//Unknown animation state
+			result = true;
+		} else if(!isAnimationFinished(animationIte->second)) {
+			//The animation keeps running
+			result = true;
 		} else {
 			//Nothing has changed :-)
 			result = false;
@@ -669,7 +905,9 @@ struct VideoSurfaceImpl {
 		const auto& lastElement = videoIn.getLastElement();
 
 		if(lastElement) {
-			if(lastElement->getDescriptor()) {
+			if(shape != VideoSurface::Shape::rectangle) {
+				result = true; //Anti-aliased edges are translucent
+			} else if(lastElement->getDescriptor()) {
 				result = Zuazo::hasAlpha(lastElement->getDescriptor()->getColorFormat());
 			} else {
 				result = true; //We dont know, better stay safe than sorry.
@@ -689,21 +927,27 @@ struct VideoSurfaceImpl {
 
 		if(opened) {
 			const auto& frame = videoIn.pull();
+			const auto animationTime = calculateAnimationTime();
 			
 			//Draw
 			if(frame) {
 				opened->draw(
 					cmd, 
 					frame, 
-					videoSurface.getScalingFilter(),
+					Renderers::Compositor::limitScalingFilter(renderer, videoSurface.getScalingFilter()),
 					videoSurface.getRenderPass(),
 					videoSurface.getBlendingMode(),
-					videoSurface.getRenderingLayer()
+					videoSurface.getRenderingLayer(),
+					animationTime
 				);
 			}
 
 			//Update the state for next hasChanged()
 			lastFrames[&renderer] = frame;
+			lastAnimationTimes[&renderer] = animationTime;
+
+			//Let the source know how big it is being displayed
+			updateProjectedSize(videoSurface, renderer);
 		}
 	}
 
@@ -741,6 +985,12 @@ struct VideoSurfaceImpl {
 
 	void renderPassCallback(LayerBase& base, vk::RenderPass renderPass) {
 		auto& videoSurface = static_cast<VideoSurface&>(base);
+
+		//Renderers have been attached or detached. Sizes will be 
+		//reported again by the ones drawing it
+		projectedSizes.clear();
+		notifyProjectedSize();
+
 		recreateCallback(videoSurface, renderPass, videoSurface.getBlendingMode());
 	}
 
@@ -779,7 +1029,271 @@ struct VideoSurfaceImpl {
 		return size;
 	}
 
+	const Video& getLastFrame() const {
+		return videoIn.getLastElement();
+	}
+
+
+	void setAnimation(	Utils::BufferView<const VideoSurface::Keyframe> keyframes,
+						TimePoint startTime,
+						bool loop )
+	{
+		assert(std::is_sorted(
+			keyframes.cbegin(), keyframes.cend(),
+			[] (const VideoSurface::Keyframe& a, const VideoSurface::Keyframe& b) -> bool {
+				return a.time < b.time;
+			}
+		));
+
+		animation.assign(keyframes.cbegin(), keyframes.cend());
+		animationStartTime = startTime;
+		animationLoop = loop;
+
+		if(opened) {
+			opened->updateAnimationUniform(animation);
+		}
+
+		lastFrames.clear(); //Will force hasChanged() to true
+	}
+
+	Utils::BufferView<const VideoSurface::Keyframe> getAnimation() const {
+		return animation;
+	}
+
+	TimePoint getAnimationStartTime() const {
+		return animationStartTime;
+	}
+
+	bool getAnimationLoop() const {
+		return animationLoop;
+	}
+
+
+	void setShape(VideoSurface::Shape shape) {
+		if(this->shape != shape) {
+			this->shape = shape;
+
+			if(opened) {
+				opened->setShape(this->shape);
+			}
+
+			lastFrames.clear(); //Will force hasChanged() to true
+		}
+	}
+
+	VideoSurface::Shape getShape() const {
+		return shape;
+	}
+
+
+	void setCornerRadius(float radius) {
+		if(this->cornerRadius != radius) {
+			this->cornerRadius = radius;
+
+			if(opened) {
+				opened->updateCornerRadiusUniform(this->cornerRadius);
+			}
+
+			lastFrames.clear(); //Will force hasChanged() to true
+		}
+	}
+
+	float getCornerRadius() const {
+		return cornerRadius;
+	}
+
+
+	void setProjectedSizeCallback(VideoSurface::ProjectedSizeCallback cbk) {
+		projectedSizeCallback = std::move(cbk);
+	}
+
+	const VideoSurface::ProjectedSizeCallback& getProjectedSizeCallback() const {
+		return projectedSizeCallback;
+	}
+
+	Resolution getProjectedSize() const {
+		return projectedSize;
+	}
+
+	void clearProjectedSize(const RendererBase& renderer) {
+		if(projectedSizes.erase(&renderer)) {
+			notifyProjectedSize();
+		}
+	}
+
+	std::vector<VideoMode> getPreferredVideoModes() const {
+		return Layers::getPreferredVideoModes(owner.get().getInstance());
+	}
+
+
+	Math::Mat4x4f calculateAnimationMatrix() const {
+		Math::Mat4x4f result(1.0f);
+
+		if(animation.size()) {
+			//Same evaluation as in the vertex shader
+			const auto time = calculateAnimationTime();
+
+			//Find the keyframes surrounding the current time
+			size_t next = 0;
+			while(next < animation.size() && Open::toSeconds(animation[next].time) <= time) {
+				++next;
+			}
+			const auto prev = std::max(next, size_t(1)) - 1;
+			next = std::min(next, animation.size() - 1);
+
+			//Interpolate between them
+			const auto& a = animation[prev];
+			const auto& b = animation[next];
+			const auto span = Open::toSeconds(b.time - a.time);
+			const auto x = span > 0.0f ? std::clamp((time - Open::toSeconds(a.time)) / span, 0.0f, 1.0f) : 0.0f;
+			const auto f = ease(a.easing, x);
+			const auto position = a.position + (b.position - a.position) * f;
+			const auto scale = a.scale + (b.scale - a.scale) * f;
+			const auto rotation = a.rotation + (b.rotation - a.rotation) * f;
+
+			//Compose translation * rotation * scale
+			const auto c = std::cos(rotation);
+			const auto s = std::sin(rotation);
+			result = Math::Mat4x4f(
+				Math::Vec4f(+c*scale.x, s*scale.x, 0.0f, 0.0f),
+				Math::Vec4f(-s*scale.y, c*scale.y, 0.0f, 0.0f),
+				Math::Vec4f(0.0f, 0.0f, 1.0f, 0.0f),
+				Math::Vec4f(position, 1.0f)
+			);
+		}
+
+		return result;
+	}
+
+	bool isOpaque() const {
+		const auto& videoSurface = owner.get();
+		const auto scalingMode = videoSurface.getScalingMode();
+		const auto blendingMode = videoSurface.getBlendingMode();
+
+		//When a new frame is pending it is unknown until it gets pulled
+		//for drawing, so only the last frame can be judged
+		return	opened &&
+				!videoIn.hasChanged() &&
+				videoIn.getLastElement() &&
+				!hasAlphaCallback(videoSurface) &&
+				videoSurface.getOpacity() >= 1.0f &&
+				animation.empty() &&
+				(scalingMode == ScalingMode::stretch || scalingMode == ScalingMode::cropped) &&
+				(blendingMode == BlendingMode::write || blendingMode == BlendingMode::opacity) ;
+	}
+
 private:
+	float calculateAnimationTime() const {
+		auto elapsed = std::chrono::duration_cast<Duration>(owner.get().getInstance().getTime() - animationStartTime);
+
+		//Wrap or clamp it before converting to float, as its precision 
+		//would degrade with the uptime otherwise
+		if(animation.size()) {
+			const auto duration = animation.back().time;
+
+			if(animationLoop && duration > Duration::zero()) {
+				elapsed %= duration;
+				if(elapsed < Duration::zero()) {
+					elapsed += duration;
+				}
+			} else {
+				elapsed = std::min(elapsed, duration);
+			}
+		}
+
+		return Open::toSeconds(elapsed);
+	}
+
+	void updateProjectedSize(const VideoSurface& videoSurface, const RendererBase& renderer) {
+		//Project the corners of the surface to obtain its size in pixels
+		const auto viewportSize = renderer.getViewportSize();
+		const auto mvp = 	renderer.getCamera().calculateMatrix(viewportSize) * 
+							videoSurface.getTransform().calculateMatrix() ;
+		const auto halfSize = size / 2.0f;
+
+		Math::Vec2f min(std::numeric_limits<float>::max());
+		Math::Vec2f max(std::numeric_limits<float>::lowest());
+		for(const auto& corner : { Math::Vec2f(-halfSize.x, -halfSize.y), Math::Vec2f(halfSize.x, -halfSize.y), Math::Vec2f(-halfSize.x, halfSize.y), halfSize }) {
+			const auto clip = mvp * Math::Vec4f(corner, 0.0f, 1.0f);
+			const auto pixel = Math::Vec2f(clip.x, clip.y) / std::max(std::abs(clip.w), std::numeric_limits<float>::epsilon()) * viewportSize / 2.0f;
+			min.x = std::min(min.x, pixel.x);
+			min.y = std::min(min.y, pixel.y);
+			max.x = std::max(max.x, pixel.x);
+			max.y = std::max(max.y, pixel.y);
+		}
+
+		//Animations may enlarge it. Consider the biggest scale
+		float animationScale = 1.0f;
+		for(const auto& keyframe : animation) {
+			animationScale = std::max({ animationScale, std::abs(keyframe.scale.x), std::abs(keyframe.scale.y) });
+		}
+
+		//The surface does not need to be larger than the viewport
+		projectedSizes[&renderer] = Math::Vec2f(
+			std::min((max.x - min.x) * animationScale, viewportSize.x),
+			std::min((max.y - min.y) * animationScale, viewportSize.y)
+		);
+
+		notifyProjectedSize();
+	}
+
+	void notifyProjectedSize() {
+		//Use the biggest size among all the renderers. Zero if none
+		Math::Vec2f required(0.0f);
+		for(const auto& s : projectedSizes) {
+			required.x = std::max(required.x, s.second.x);
+			required.y = std::max(required.y, s.second.y);
+		}
+
+		//Only notify when growing beyond the last size or when shrinking 
+		//substantially. This avoids renegotiating every frame while zooming
+		const Math::Vec2f current(projectedSize.width, projectedSize.height);
+		const bool grow = required.x > current.x || required.y > current.y;
+		const bool shrink = 	required.x < current.x*PROJECTED_SIZE_SHRINK_RATIO &&
+								required.y < current.y*PROJECTED_SIZE_SHRINK_RATIO ;
+
+		if(grow || shrink) {
+			projectedSize = Resolution(
+				static_cast<uint32_t>(std::ceil(required.x * PROJECTED_SIZE_HEADROOM)),
+				static_cast<uint32_t>(std::ceil(required.y * PROJECTED_SIZE_HEADROOM))
+			);
+
+			if(projectedSizeCallback) {
+				projectedSizeCallback(owner, projectedSize);
+			}
+		}
+	}
+
+	static float ease(const Math::Vec4f& easing, float x) noexcept {
+		//Solve the curve parameter for x using Newton-Raphson
+		float t = x;
+		for(size_t i = 0; i < 4; ++i) {
+			const auto s = 1.0f - t;
+			const auto bx = 3.0f*s*s*t*easing.x + 3.0f*s*t*t*easing.z + t*t*t;
+			const auto dx = 3.0f*s*s*easing.x + 6.0f*s*t*(easing.z - easing.x) + 3.0f*t*t*(1.0f - easing.z);
+			if(std::abs(dx) < 1e-6f) {
+				break;
+			}
+
+			t = std::clamp(t - (bx - x) / dx, 0.0f, 1.0f);
+		}
+
+		//Evaluate y for it
+		const auto s = 1.0f - t;
+		return 3.0f*s*s*t*easing.y + 3.0f*s*t*t*easing.w + t*t*t;
+	}
+
+	bool isAnimationFinished(float time) const noexcept {
+		if(animation.size() < 2) {
+			return true; //Static
+		} else if(animationLoop) {
+			return false; //Never finishes
+		} else {
+			return time >= Open::toSeconds(animation.back().time);
+		}
+	}
+
+
 	void recreateCallback(	VideoSurface& videoSurface, 
 							vk::RenderPass renderPass,
 							BlendingMode blendingMode )
@@ -855,4 +1369,76 @@ Math::Vec2f VideoSurface::getSize() const {
 	return (*this)->getSize();
 }
 
+const Video& VideoSurface::getLastFrame() const {
+	return (*this)->getLastFrame();
+}
+
+
+void VideoSurface::setAnimation(Utils::BufferView<const Keyframe> keyframes,
+								TimePoint startTime,
+								bool loop )
+{
+	(*this)->setAnimation(keyframes, startTime, loop);
+}
+
+Utils::BufferView<const VideoSurface::Keyframe> VideoSurface::getAnimation() const {
+	return (*this)->getAnimation();
+}
+
+TimePoint VideoSurface::getAnimationStartTime() const {
+	return (*this)->getAnimationStartTime();
+}
+
+bool VideoSurface::getAnimationLoop() const {
+	return (*this)->getAnimationLoop();
+}
+
+
+void VideoSurface::setShape(Shape shape) {
+	(*this)->setShape(shape);
+}
+
+VideoSurface::Shape VideoSurface::getShape() const {
+	return (*this)->getShape();
+}
+
+
+void VideoSurface::setCornerRadius(float radius) {
+	(*this)->setCornerRadius(radius);
+}
+
+float VideoSurface::getCornerRadius() const {
+	return (*this)->getCornerRadius();
+}
+
+
+Math::Mat4x4f VideoSurface::calculateAnimationMatrix() const {
+	return (*this)->calculateAnimationMatrix();
+}
+
+bool VideoSurface::isOpaque() const {
+	return (*this)->isOpaque();
+}
+
+
+void VideoSurface::setProjectedSizeCallback(ProjectedSizeCallback cbk) {
+	(*this)->setProjectedSizeCallback(std::move(cbk));
+}
+
+const VideoSurface::ProjectedSizeCallback& VideoSurface::getProjectedSizeCallback() const {
+	return (*this)->getProjectedSizeCallback();
+}
+
+Resolution VideoSurface::getProjectedSize() const {
+	return (*this)->getProjectedSize();
+}
+
+void VideoSurface::clearProjectedSize(const RendererBase& renderer) {
+	(*this)->clearProjectedSize(renderer);
+}
+
+std::vector<VideoMode> VideoSurface::getPreferredVideoModes() const {
+	return (*this)->getPreferredVideoModes();
+}
+
 }
\ No newline at end of file
@@ -1,22 +1,36 @@
 #include <zuazo/Renderers/Compositor.h>
 
 #include <zuazo/LayerBase.h>
+#include <zuazo/Layers/StencilMask.h>
+#include <zuazo/Layers/VideoSurface.h>
+#include <zuazo/Layers/BezierCrop.h>
 #include <zuazo/Graphics/CommandBuffer.h>
 #include <zuazo/Graphics/UniformBuffer.h>
 #include <zuazo/Graphics/TargetFramePool.h>
 #include <zuazo/Graphics/CommandBufferPool.h>
+#include <zuazo/Graphics/VulkanConversions.h>
 #include <zuazo/Signal/Input.h>
 #include <zuazo/Signal/Output.h>
 #include <zuazo/Utils/Pool.h>
 #include <zuazo/Utils/StaticId.h>
+#include <zuazo/Utils/Hasher.h>
+#include <zuazo/Math/Geometry.h>
 
 
 #include <memory>
 #include <vector>
+#include <list>
+#include <unordered_map>
 #include <utility>
 #include <algorithm>
 #include <tuple>
 #include <bitset>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <limits>
+#include <array>
+#include <cmath>
 
 namespace Zuazo::Renderers {
 
@@ -44,6 +58,326 @@ struct CompositorImpl {
 			std::vector<Compositor::LayerRef>			layers;
 		};
 
+		struct Occluder {
+			Math::Vec2f									min;
+			Math::Vec2f									max;
+			RenderingLayer								renderingLayer;
+		};
+
+		static constexpr size_t MAX_OCCLUDER_COUNT = 16;
+
+		class LayerBvh {
+		public:
+			struct Leaf {
+				const LayerBase*						layer = nullptr;
+				bool									bounded = false;
+				Math::Vec2f								localMin;
+				Math::Vec2f								localMax;
+				Math::Mat4x4f							modelMatrix;
+				Math::Vec3f								min;
+				Math::Vec3f								max;
+				uint64_t								generation = 0;
+			};
+
+			LayerBvh() = default;
+			~LayerBvh() = default;
+
+			void update(Utils::BufferView<const Compositor::LayerRef> layers, 
+						std::vector<size_t>& layerSlots ) 
+			{
+				bool rebuild = false;
+				bool refit = false;
+				layerSlots.resize(layers.size());
+				++generation;
+
+				//Update the leaves which have changed. Leaves are kept in 
+				//per-layer slots, so that reordering, inserting or removing
+				//layers does not invalidate the state of the rest
+				for(size_t i = 0; i < layers.size(); ++i) {
+					const auto& layer = layers[i].get();
+					const auto slot = getSlot(layer);
+					auto& leaf = leaves[slot];
+					layerSlots[i] = slot;
+					leaf.generation = generation;
+
+					Math::Vec2f localMin, localMax;
+					const auto bounded = getBoundaries(layer, localMin, localMax);
+					const auto modelMatrix = layer.getTransform().calculateMatrix();
+
+					if(leaf.layer != &layer || leaf.bounded != bounded) {
+						//The structure needs to be changed
+						rebuild = true;
+					} else if(	bounded && (
+								leaf.localMin != localMin || 
+								leaf.localMax != localMax || 
+								leaf.modelMatrix != modelMatrix ) )
+					{
+						//Only the boundaries have changed
+						refit = true;
+					} else {
+						continue; //Nothing has changed
+					}
+
+					leaf.layer = &layer;
+					leaf.bounded = bounded;
+					leaf.localMin = localMin;
+					leaf.localMax = localMax;
+					leaf.modelMatrix = modelMatrix;
+					calculateWorldBoundaries(leaf);
+				}
+
+				//Release the leaves of the removed layers
+				if(slots.size() != layers.size()) {
+					for(auto ite = slots.begin(); ite != slots.end(); ) {
+						auto& leaf = leaves[ite->second];
+
+						if(leaf.generation != generation) {
+							leaf = Leaf();
+							freeSlots.push_back(ite->second);
+							ite = slots.erase(ite);
+							rebuild = true;
+						} else {
+							++ite;
+						}
+					}
+				}
+
+				if(rebuild) {
+					build();
+				} else if(refit) {
+					this->refit();
+				}
+			}
+
+			void query(const Math::Mat4x4f& projectionMatrix, std::vector<bool>& visible) const {
+				visible.assign(leaves.size(), false);
+
+				//Unbounded leaves are always potentially visible
+				for(size_t i = 0; i < leaves.size(); ++i) {
+					if(leaves[i].layer && !leaves[i].bounded) {
+						visible[i] = true;
+					}
+				}
+
+				//Traverse the tree discarding the nodes outside the view
+				std::vector<size_t> stack;
+				if(nodes.size()) {
+					stack.push_back(0);
+				}
+
+				while(stack.size()) {
+					const auto& node = nodes[stack.back()];
+					stack.pop_back();
+
+					if(isOutside(projectionMatrix, node.min, node.max)) {
+						continue;
+					}
+
+					if(node.count) {
+						for(size_t i = node.first; i < node.first + node.count; ++i) {
+							const auto& leaf = leaves[order[i]];
+							visible[order[i]] = !isOutside(projectionMatrix, leaf.min, leaf.max);
+						}
+					} else {
+						stack.push_back(node.left);
+						stack.push_back(node.right);
+					}
+				}
+			}
+
+			void query(	const Math::Vec3f& origin, 
+						const Math::Vec3f& direction, 
+						std::vector<bool>& hit ) const 
+			{
+				hit.assign(leaves.size(), false);
+				const auto invDirection = Math::Vec3f(1.0f) / direction;
+
+				//Unbounded leaves need to be tested by the caller
+				for(size_t i = 0; i < leaves.size(); ++i) {
+					if(leaves[i].layer && !leaves[i].bounded) {
+						hit[i] = true;
+					}
+				}
+
+				//Traverse the tree discarding the nodes not crossed by the ray
+				std::vector<size_t> stack;
+				if(nodes.size()) {
+					stack.push_back(0);
+				}
+
+				while(stack.size()) {
+					const auto& node = nodes[stack.back()];
+					stack.pop_back();
+
+					if(!intersects(origin, invDirection, node.min, node.max)) {
+						continue;
+					}
+
+					if(node.count) {
+						for(size_t i = node.first; i < node.first + node.count; ++i) {
+							const auto& leaf = leaves[order[i]];
+							hit[order[i]] = intersects(origin, invDirection, leaf.min, leaf.max);
+						}
+					} else {
+						stack.push_back(node.left);
+						stack.push_back(node.right);
+					}
+				}
+			}
+
+			const Leaf& getLeaf(size_t index) const {
+				return leaves[index];
+			}
+
+		private:
+			struct Node {
+				Math::Vec3f								min;
+				Math::Vec3f								max;
+				size_t									left;	//Only for inner nodes
+				size_t									right;	//Only for inner nodes
+				size_t									first;	//Only for leaf nodes
+				size_t									count;	//Zero for inner nodes
+			};
+
+			static constexpr size_t MAX_LEAVES_PER_NODE = 4;
+
+			std::vector<Leaf>							leaves;
+			std::unordered_map<const LayerBase*, size_t> slots;
+			std::vector<size_t>							freeSlots;
+			uint64_t									generation = 0;
+			std::vector<size_t>							order;
+			std::vector<Node>							nodes;
+
+			size_t getSlot(const LayerBase& layer) {
+				auto ite = slots.find(&layer);
+
+				if(ite == slots.end()) {
+					//New layer, reuse a free slot if possible
+					size_t slot;
+					if(freeSlots.size()) {
+						slot = freeSlots.back();
+						freeSlots.pop_back();
+					} else {
+						slot = leaves.size();
+						leaves.emplace_back();
+					}
+
+					assert(!leaves[slot].layer);
+					ite = slots.emplace(&layer, slot).first;
+				}
+
+				return ite->second;
+			}
+
+			void build() {
+				order.clear();
+				nodes.clear();
+
+				for(size_t i = 0; i < leaves.size(); ++i) {
+					if(leaves[i].layer && leaves[i].bounded) {
+						order.push_back(i);
+					}
+				}
+
+				if(order.size()) {
+					buildNode(0, order.size());
+				}
+			}
+
+			size_t buildNode(size_t first, size_t count) {
+				const auto index = nodes.size();
+				nodes.emplace_back();
+
+				//Obtain the boundaries of the contained leaves
+				Math::Vec3f min(std::numeric_limits<float>::max());
+				Math::Vec3f max(std::numeric_limits<float>::lowest());
+				for(size_t i = first; i < first + count; ++i) {
+					min = Math::min(min, leaves[order[i]].min);
+					max = Math::max(max, leaves[order[i]].max);
+				}
+
+				size_t left = 0, right = 0;
+				if(count > MAX_LEAVES_PER_NODE) {
+					//Split along the largest axis by the median centroid
+					const auto extent = max - min;
+					const size_t axis = 	(extent.x >= extent.y && extent.x >= extent.z) ? 0 :
+											(extent.y >= extent.z) ? 1 : 2 ;
+					const auto half = count / 2;
+					std::nth_element(
+						order.begin() + first,
+						order.begin() + first + half,
+						order.begin() + first + count,
+						[this, axis] (size_t a, size_t b) -> bool {
+							return 	(leaves[a].min[axis] + leaves[a].max[axis]) < 
+									(leaves[b].min[axis] + leaves[b].max[axis]) ;
+						}
+					);
+
+					left = buildNode(first, half);
+					right = buildNode(first + half, count - half);
+					first = count = 0;
+				}
+
+				nodes[index] = Node{ min, max, left, right, first, count };
+				return index;
+			}
+
+			void refit() {
+				//Children are always placed after their parents
+				for(auto ite = nodes.rbegin(); ite != nodes.rend(); ++ite) {
+					auto& node = *ite;
+
+					if(node.count) {
+						node.min = Math::Vec3f(std::numeric_limits<float>::max());
+						node.max = Math::Vec3f(std::numeric_limits<float>::lowest());
+						for(size_t i = node.first; i < node.first + node.count; ++i) {
+							node.min = Math::min(node.min, leaves[order[i]].min);
+							node.max = Math::max(node.max, leaves[order[i]].max);
+						}
+					} else {
+						node.min = Math::min(nodes[node.left].min, nodes[node.right].min);
+						node.max = Math::max(nodes[node.left].max, nodes[node.right].max);
+					}
+				}
+			}
+
+			static bool intersects(	const Math::Vec3f& origin,
+									const Math::Vec3f& invDirection,
+									const Math::Vec3f& min,
+									const Math::Vec3f& max ) noexcept
+			{
+				//Slab test. The ray spans from the near to the far plane
+				float tMin = 0.0f;
+				float tMax = 1.0f;
+				for(size_t i = 0; i < 3; ++i) {
+					const auto t0 = (min[i] - origin[i]) * invDirection[i];
+					const auto t1 = (max[i] - origin[i]) * invDirection[i];
+					tMin = std::max(tMin, std::min(t0, t1));
+					tMax = std::min(tMax, std::max(t0, t1));
+				}
+
+				return tMin <= tMax;
+			}
+
+			static void calculateWorldBoundaries(Leaf& leaf) {
+				leaf.min = Math::Vec3f(std::numeric_limits<float>::max());
+				leaf.max = Math::Vec3f(std::numeric_limits<float>::lowest());
+
+				if(leaf.bounded) {
+					for(const auto& corner : {	Math::Vec2f(leaf.localMin.x, leaf.localMin.y),
+												Math::Vec2f(leaf.localMax.x, leaf.localMin.y),
+												Math::Vec2f(leaf.localMin.x, leaf.localMax.y),
+												Math::Vec2f(leaf.localMax.x, leaf.localMax.y) } )
+					{
+						const auto transformed = leaf.modelMatrix * Math::Vec4f(corner, 0.0f, 1.0f);
+						const auto position = Math::Vec3f(transformed.x, transformed.y, transformed.z);
+						leaf.min = Math::min(leaf.min, position);
+						leaf.max = Math::max(leaf.max, position);
+					}
+				}
+			}
+		};
+
 		const Graphics::Vulkan& 					vulkan;
 
 		std::shared_ptr<Resources>					resources;
@@ -54,6 +388,31 @@ struct CompositorImpl {
 		Graphics::CommandBufferPool					commandBufferPool;
 		
 		Utils::BufferView<const vk::ClearValue>		clearValues;
+		DepthStencilFormat							depthStencilFormat;
+
+		Duration									frameTimeBudget;
+		size_t										governorLevel;
+		float										averageFrameTime;
+		size_t										overBudgetCount;
+		size_t										underBudgetCount;
+		size_t										cooldownCount;
+		size_t										downscaleCount;
+		size_t										upscaleCount;
+		std::unique_ptr<Graphics::TargetFramePool>	scaledFramePool;
+		vk::DescriptorSetLayout						upscaleDescriptorSetLayout;
+		vk::PipelineLayout							upscalePipelineLayout;
+		vk::Pipeline								upscalePipeline;
+		uint32_t									upscaleSampleMode;
+
+		Math::Mat4x4f								projectionMatrix;
+		LayerBvh									layerBvh;
+		std::vector<size_t>							layerSlots;
+		std::vector<bool>							visibleSlots;
+		std::vector<bool>							visibleLayers;
+		std::vector<bool>							pickedSlots;
+		std::vector<bool>							maskedLayers;
+		std::vector<Occluder>						occluders;
+		std::vector<const LayerBase*>				lastVisibleLayers;
 
 		Open(	const Graphics::Vulkan& vulkan, 
 				const Graphics::Frame::Descriptor& frameDesc,
@@ -69,6 +428,29 @@ struct CompositorImpl {
 			, commandBufferPool(createCommandBufferPool(vulkan))
 
 			, clearValues(Graphics::RenderPass::getClearValues(depthStencilFmt))
+			, depthStencilFormat(depthStencilFmt)
+			, frameTimeBudget()
+			, governorLevel(0)
+			, averageFrameTime(0)
+			, overBudgetCount(0)
+			, underBudgetCount(0)
+			, cooldownCount(0)
+			, downscaleCount(0)
+			, upscaleCount(0)
+			, scaledFramePool()
+			, upscaleDescriptorSetLayout()
+			, upscalePipelineLayout()
+			, upscalePipeline()
+			, upscaleSampleMode(-1)
+			, projectionMatrix()
+			, layerBvh()
+			, layerSlots()
+			, visibleSlots()
+			, visibleLayers()
+			, pickedSlots()
+			, maskedLayers()
+			, occluders()
+			, lastVisibleLayers()
 		{
 			//Bind the uniform buffers to the descriptor sets
 			resources->uniformBuffer.writeDescirptorSet(vulkan, descriptorSet);
@@ -106,6 +488,14 @@ struct CompositorImpl {
 
 			if(modifications.test(RECREATE_CLEAR_VALUES)) {
 				clearValues = Graphics::RenderPass::getClearValues(depthStencilFmt);
+				depthStencilFormat = depthStencilFmt;
+			}
+
+			if(modifications.test(RECREATE_DRAWTABLE)) {
+				//Recreate the reduced resolution frames for the new output
+				scaledFramePool.reset();
+				upscaleDescriptorSetLayout = nullptr;
+				setGovernorLevel(governorLevel);
 			}
 
 			if(modifications.test(UPDATE_PROJECTION_MATRIX)) {
@@ -117,9 +507,331 @@ struct CompositorImpl {
 			updateProjectionMatrixUniform(cam);
 		}
 
+		void updateVisibility(const RendererBase& renderer) {
+			const auto layers = renderer.getLayers();
+
+			//Coarse culling using the hierarchy
+			layerBvh.update(layers, layerSlots);
+			layerBvh.query(projectionMatrix, visibleSlots);
+			assert(layerSlots.size() == layers.size());
+
+			//Fine culling of the remaining layers
+			visibleLayers.resize(layers.size());
+			for(size_t i = 0; i < layers.size(); ++i) {
+				const auto slot = layerSlots[i];
+				visibleLayers[i] = 	visibleSlots[slot] && 
+									isVisible(layers[i].get(), layerBvh.getLeaf(slot)) ;
+			}
+
+			//Resolve which layers are clipped by a mask
+			updateMaskedLayers(layers);
+
+			//Discard the layers hidden behind opaque ones
+			cullOccludedLayers(layers);
+
+			//Culled surfaces are not drawn, so they would not report
+			//that they are no longer displayed
+			for(size_t i = 0; i < layers.size(); ++i) {
+				if(!visibleLayers[i]) {
+					if(auto* videoSurface = dynamic_cast<Layers::VideoSurface*>(&layers[i].get())) {
+						videoSurface->clearProjectedSize(renderer);
+					}
+				}
+			}
+		}
+
+		void updateMaskedLayers(Utils::BufferView<const Compositor::LayerRef> layers) {
+			//The stencil only holds a single mask, so the ones found inside
+			//the range of another mask are not drawn. Neither are their 
+			//end layers, as they would clear the enclosing mask
+			maskedLayers.assign(layers.size(), false);
+			const Layers::StencilMask* currentMask = nullptr;
+			for(size_t i = 0; i < layers.size(); ++i) {
+				const auto& layer = layers[i].get();
+				if(const auto* mask = dynamic_cast<const Layers::StencilMask*>(&layer)) {
+					if(currentMask) {
+						visibleLayers[i] = false; //Nested
+					} else {
+						currentMask = mask;
+					}
+				} else if(Layers::StencilMask::isEndLayer(layer)) {
+					if(currentMask && &currentMask->getEndLayer() == &layer) {
+						currentMask = nullptr;
+					} else {
+						visibleLayers[i] = false; //Ends an ignored mask
+					}
+				} else {
+					maskedLayers[i] = currentMask != nullptr;
+				}
+			}
+		}
+
+		void cullOccludedLayers(Utils::BufferView<const Compositor::LayerRef> layers) {
+			//Traverse from top to bottom, collecting the occluders and 
+			//testing the layers against the ones above them
+			occluders.clear();
+			for(size_t i = layers.size(); i > 0; --i) {
+				const auto index = i - 1;
+				const auto& layer = layers[index].get();
+				const auto& leaf = layerBvh.getLeaf(layerSlots[index]);
+
+				if(!visibleLayers[index] || !leaf.bounded || !isOcclusionCandidate(layer)) {
+					continue;
+				}
+
+				Math::Vec2f min, max;
+				bool axisAligned;
+				if(!calculateScreenBoundaries(leaf, min, max, axisAligned)) {
+					continue; //Crosses the camera plane
+				}
+
+				//Check if any of the layers above hides it
+				const auto isOccluded = std::any_of(
+					occluders.cbegin(), occluders.cend(),
+					[&layer, &min, &max] (const Occluder& occluder) -> bool {
+						return 	occluder.renderingLayer == layer.getRenderingLayer() &&
+								occluder.min.x <= min.x && occluder.min.y <= min.y &&
+								occluder.max.x >= max.x && occluder.max.y >= max.y ;
+					}
+				);
+
+				if(isOccluded) {
+					visibleLayers[index] = false;
+				} else if(	axisAligned && 
+							!maskedLayers[index] && 
+							occluders.size() < MAX_OCCLUDER_COUNT &&
+							isOpaque(layer) ) 
+				{
+					occluders.push_back(Occluder{ min, max, layer.getRenderingLayer() });
+				}
+			}
+		}
+
+		LayerBase* pick(const RendererBase& renderer, Math::Vec2f position) {
+			const auto layers = renderer.getLayers();
+
+			//Transforms may have changed since the last frame
+			layerBvh.update(layers, layerSlots);
+			assert(layerSlots.size() == layers.size());
+
+			//Unproject the position into a ray. Position is given in pixels
+			//from the top left corner of the viewport
+			const auto viewportSize = framePool.getFrameDescriptor().calculateSize();
+			const auto ndc = position / viewportSize * 2.0f - Math::Vec2f(1.0f);
+			const auto invProjection = Math::inv(projectionMatrix);
+			const auto nearPoint = invProjection * Math::Vec4f(ndc, 0.0f, 1.0f);
+			const auto farPoint = invProjection * Math::Vec4f(ndc, 1.0f, 1.0f);
+			const auto origin = Math::Vec3f(nearPoint.x, nearPoint.y, nearPoint.z) / nearPoint.w;
+			const auto direction = Math::Vec3f(farPoint.x, farPoint.y, farPoint.z) / farPoint.w - origin;
+
+			//Obtain the candidates from the hierarchy
+			layerBvh.query(origin, direction, pickedSlots);
+
+			//Find the nearest hit. Traverse from top to bottom, so that
+			//on ties the last drawn layer is chosen
+			LayerBase* result = nullptr;
+			float nearest = std::numeric_limits<float>::max();
+			for(size_t i = layers.size(); i > 0; --i) {
+				const auto slot = layerSlots[i - 1];
+				auto& layer = layers[i - 1].get();
+				const auto& leaf = layerBvh.getLeaf(slot);
+
+				if(!pickedSlots[slot] || layer.getOpacity() <= 0.0f) {
+					continue;
+				}
+
+				//Leaves of animated surfaces cover the whole animation, so 
+				//they are tested with their current extent, as the unbounded
+				//ones
+				auto modelMatrix = leaf.modelMatrix;
+				auto localMin = leaf.localMin;
+				auto localMax = leaf.localMax;
+				if(!getCurrentBoundaries(layer, modelMatrix, localMin, localMax) && !leaf.bounded) {
+					continue; //Unknown extent. Can not be picked
+				}
+
+				//Intersect the ray with the plane of the layer
+				const auto invModelMatrix = Math::inv(modelMatrix);
+				const auto localOrigin = invModelMatrix * Math::Vec4f(origin, 1.0f);
+				const auto localDirection = invModelMatrix * Math::Vec4f(direction, 0.0f);
+				if(localDirection.z == 0.0f) {
+					continue; //Parallel to the layer
+				}
+
+				const auto t = -localOrigin.z / localDirection.z;
+				if(t < 0.0f || t > 1.0f || t >= nearest) {
+					continue;
+				}
+
+				const auto point = Math::Vec2f(
+					localOrigin.x + localDirection.x*t, 
+					localOrigin.y + localDirection.y*t
+				);
+
+				if(isInside(layer, localMin, localMax, point)) {
+					result = &layer;
+					nearest = t;
+				}
+			}
+
+			return result;
+		}
+
+		bool layersHaveChanged(const RendererBase& renderer) const {
+			const auto layers = renderer.getLayers();
+			assert(visibleLayers.size() == layers.size());
+
+			//Only the visible layers are considered. However, if the set
+			//of visible layers changes, it needs to be redrawn
+			bool result = false;
+			size_t visibleCount = 0;
+
+			for(size_t i = 0; i < layers.size(); ++i) {
+				if(visibleLayers[i]) {
+					const auto& layer = layers[i].get();
+					result |= 	visibleCount >= lastVisibleLayers.size() ||
+								lastVisibleLayers[visibleCount] != &layer ;
+					result |= layer.hasChanged(renderer);
+					++visibleCount;
+				}
+			}
+
+			result |= visibleCount != lastVisibleLayers.size();
+			return result;
+		}
+
+		void setFrameTimeBudget(Duration budget) {
+			frameTimeBudget = budget;
+			overBudgetCount = 0;
+			underBudgetCount = 0;
+
+			if(frameTimeBudget <= Duration::zero()) {
+				//Disabled. Go back to the full quality
+				setGovernorLevel(0);
+			}
+		}
+
+		Compositor::GovernorStatistics getGovernorStatistics() const {
+			return Compositor::GovernorStatistics {
+				GOVERNOR_LEVELS[governorLevel].renderScale,
+				GOVERNOR_LEVELS[governorLevel].reducedFiltering,
+				std::chrono::duration_cast<Duration>(std::chrono::duration<float>(averageFrameTime)),
+				downscaleCount,
+				upscaleCount
+			};
+		}
+
+		bool isFilteringReduced() const noexcept {
+			return GOVERNOR_LEVELS[governorLevel].reducedFiltering;
+		}
+
 		Video draw(RendererBase& renderer) {
+			const auto begin = std::chrono::steady_clock::now();
+			Video result;
+
+			if(GOVERNOR_LEVELS[governorLevel].renderScale < 1.0f) {
+				//Render at a reduced resolution and upscale it
+				assert(scaledFramePool);
+				result = upscale(renderFrame(renderer, *scaledFramePool));
+			} else {
+				result = renderFrame(renderer, framePool);
+			}
+
+			//This is the CPU cost of recording and submitting the frame, 
+			//not the GPU execution time. Frame pools grow instead of
+			//blocking, so a GPU bound scene is not detected
+			const auto end = std::chrono::steady_clock::now();
+			updateGovernor(std::chrono::duration<float>(end - begin).count());
+
+			return result;
+		}
+
+	private:
+		struct GovernorLevel {
+			float	renderScale;		//Fraction of the output resolution
+			bool	reducedFiltering;	//Cubic filtering is replaced by linear
+		};
+
+		//Filtering is reduced first, as it is barely noticeable
+		static constexpr std::array<GovernorLevel, 6> GOVERNOR_LEVELS = {
+			GovernorLevel{ 1.0f, false },
+			GovernorLevel{ 1.0f, true },
+			GovernorLevel{ 0.85f, true },
+			GovernorLevel{ 0.7f, true },
+			GovernorLevel{ 0.6f, true },
+			GovernorLevel{ 0.5f, true }
+		};
+		static constexpr float FRAME_TIME_SMOOTHING = 0.1f;
+		static constexpr float UPSCALE_THRESHOLD = 0.7f; //Fraction of the budget
+		static constexpr size_t DOWNSCALE_FRAME_COUNT = 4;
+		static constexpr size_t UPSCALE_FRAME_COUNT = 120;
+		static constexpr size_t COOLDOWN_FRAME_COUNT = 30; //Average settles within 5% (0.9^30)
+
+		void updateGovernor(float frameTime) {
+			if(cooldownCount == COOLDOWN_FRAME_COUNT) {
+				//The level has just changed. Previous frame times are no 
+				//longer representative, so restart the average
+				averageFrameTime = frameTime;
+			} else {
+				averageFrameTime += (frameTime - averageFrameTime) * FRAME_TIME_SMOOTHING;
+			}
+
+			//Let the average settle after a change before taking decisions.
+			//Otherwise it lags behind and several levels are dropped at once
+			if(cooldownCount > 0) {
+				--cooldownCount;
+				return;
+			}
+
+			if(frameTimeBudget > Duration::zero()) {
+				const auto budget = std::chrono::duration<float>(frameTimeBudget).count();
+
+				//Count the consecutive frames above or well below the budget.
+				//Reacting to overload quickly but recovering slowly avoids 
+				//oscillating between levels
+				overBudgetCount = (averageFrameTime > budget) ? overBudgetCount + 1 : 0;
+				underBudgetCount = (averageFrameTime < budget*UPSCALE_THRESHOLD) ? underBudgetCount + 1 : 0;
+
+				if(overBudgetCount >= DOWNSCALE_FRAME_COUNT && governorLevel + 1 < GOVERNOR_LEVELS.size()) {
+					setGovernorLevel(governorLevel + 1);
+					++downscaleCount;
+				} else if(underBudgetCount >= UPSCALE_FRAME_COUNT && governorLevel > 0) {
+					setGovernorLevel(governorLevel - 1);
+					++upscaleCount;
+				}
+			}
+		}
+
+		void setGovernorLevel(size_t level) {
+			assert(level < GOVERNOR_LEVELS.size());
+			governorLevel = level;
+			overBudgetCount = 0;
+			underBudgetCount = 0;
+			cooldownCount = COOLDOWN_FRAME_COUNT;
+
+			const auto scale = GOVERNOR_LEVELS[governorLevel].renderScale;
+			if(scale < 1.0f) {
+				//Create a frame pool with the reduced resolution. Its renderpass
+				//is compatible with the one of the output, so that layer 
+				//pipelines can be used with it
+				auto frameDesc = framePool.getFrameDescriptor();
+				const auto resolution = frameDesc.getResolution();
+				frameDesc.setResolution(Resolution(
+					std::max(static_cast<uint32_t>(resolution.width * scale), 1U),
+					std::max(static_cast<uint32_t>(resolution.height * scale), 1U)
+				));
+
+				scaledFramePool = Utils::makeUnique<Graphics::TargetFramePool>(
+					createFramePool(vulkan, frameDesc, depthStencilFormat)
+				);
+			} else {
+				scaledFramePool.reset();
+			}
+		}
+
+		Video renderFrame(RendererBase& renderer, Graphics::TargetFramePool& targetFramePool) {
 			//Obtain the viewports and the scissors
-			const auto extent = Graphics::toVulkan(framePool.getFrameDescriptor().getResolution());
+			const auto extent = Graphics::toVulkan(targetFramePool.getFrameDescriptor().getResolution());
 			const std::array viewports = {
 				vk::Viewport(
 					0.0f, 			0.0f,
@@ -135,7 +847,7 @@ struct CompositorImpl {
 			};
 
 			//Obtain a new frame and command buffer
-			auto result = framePool.acquireFrame();
+			auto result = targetFramePool.acquireFrame();
 			auto commandBuffer = commandBufferPool.acquireCommandBuffer();
 
 			//Begin the commandbuffer
@@ -174,7 +886,7 @@ struct CompositorImpl {
 				commandBuffer->setScissor(0, scissors);
 
 				//Record all layers
-				renderer.draw(*commandBuffer);
+				drawLayers(renderer, *commandBuffer);
 			}
 
 			//Finish the command buffer
@@ -187,17 +899,162 @@ struct CompositorImpl {
 			return result;
 		}
 
-	private:
+		Video upscale(const Video& frame) {
+			constexpr auto filter = ScalingFilter::linear;
+
+			//Obtain the viewports and the scissors
+			const auto extent = Graphics::toVulkan(framePool.getFrameDescriptor().getResolution());
+			const std::array viewports = {
+				vk::Viewport(
+					0.0f, 			0.0f,
+					extent.width, 	extent.height,
+					0.0f,			1.0f
+				)
+			};
+			const std::array scissors = {
+				vk::Rect2D(
+					vk::Offset2D(0, 0),
+					extent
+				)
+			};
+
+			//Ensure the pipeline is compatible with the frame
+			const auto descriptorSetLayout = frame->getDescriptorSetLayout(filter);
+			const auto sampleMode = frame->getSamplingMode(filter);
+			if(upscaleDescriptorSetLayout != descriptorSetLayout || upscaleSampleMode != sampleMode) {
+				upscaleDescriptorSetLayout = descriptorSetLayout;
+				upscaleSampleMode = sampleMode;
+				upscalePipelineLayout = createUpscalePipelineLayout(vulkan, upscaleDescriptorSetLayout);
+				upscalePipeline = createUpscalePipeline(vulkan, upscalePipelineLayout, framePool.getRenderPass().get(), upscaleSampleMode);
+			}
+
+			//Obtain a new frame and command buffer
+			auto result = framePool.acquireFrame();
+			auto commandBuffer = commandBufferPool.acquireCommandBuffer();
+
+			//Begin the commandbuffer
+			constexpr vk::CommandBufferBeginInfo cmdBeginInfo(
+				vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+			);
+			commandBuffer->begin(cmdBeginInfo);
+
+			//The reduced resolution frame is used
+			commandBuffer->addDependencies({frame});
+
+			//Stretch the frame over the whole output
+			result->beginRenderPass(
+				commandBuffer->get(),
+				scissors.front(),
+				clearValues, 
+				vk::SubpassContents::eInline
+			);
+
+			commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, upscalePipeline);
+			commandBuffer->setViewport(0, viewports);
+			commandBuffer->setScissor(0, scissors);
+			frame->bind(
+				commandBuffer->get(), 											//Commandbuffer
+				upscalePipelineLayout, 											//Pipeline layout
+				0, 																//Descriptor set index
+				filter															//Filter
+			);
+			commandBuffer->draw(4, 1, 0, 0);
+
+			//Finish the command buffer
+			result->endRenderPass(commandBuffer->get());
+			commandBuffer->end();
+
+			//Draw to the frame
+			result->draw(std::move(commandBuffer));
+
+			return result;
+		}
+
+		void drawLayers(RendererBase& renderer, 
+						Graphics::CommandBuffer& cmd )
+		{
+			const auto layers = renderer.getLayers();
+			assert(visibleLayers.size() == layers.size());
+
+			lastVisibleLayers.clear();
+			for(size_t i = 0; i < layers.size(); ++i) {
+				if(visibleLayers[i]) {
+					lastVisibleLayers.push_back(&layers[i].get());
+				}
+			}
+
+			if(lastVisibleLayers.size() == layers.size()) {
+				//Nothing has been culled. Let the renderer record them
+				renderer.draw(cmd);
+			} else {
+				//Record the visible layers in the same order as the 
+				//renderer would. Masks and their end layers are always 
+				//visible, so the clipped ranges are preserved
+				for(const auto* layer : lastVisibleLayers) {
+					layer->draw(renderer, cmd);
+				}
+			}
+		}
+
+		bool isVisible(const LayerBase& layer, const LayerBvh::Leaf& leaf) const {
+			assert(leaf.layer == &layer);
+
+			//Masks affect other layers, so they are always drawn
+			if(dynamic_cast<const Layers::StencilMask*>(&layer) || Layers::StencilMask::isEndLayer(layer)) {
+				return true;
+			}
+
+			//Fully transparent layers are not visible, unless they
+			//overwrite the pixels behind them
+			if(layer.getOpacity() <= 0.0f && isTransparentNoOp(layer.getBlendingMode())) {
+				return false;
+			}
+
+			if(!leaf.bounded) {
+				return true; //Unknown layer. Stay on the safe side
+			}
+
+			//Check if it is smaller than a pixel. Only possible when all 
+			//corners lay in front of the camera
+			const auto mvp = projectionMatrix * leaf.modelMatrix;
+			const std::array corners = {
+				mvp * Math::Vec4f(leaf.localMin.x, leaf.localMin.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(leaf.localMax.x, leaf.localMin.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(leaf.localMin.x, leaf.localMax.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(leaf.localMax.x, leaf.localMax.y, 0.0f, 1.0f)
+			};
+
+			if(std::all_of(corners.cbegin(), corners.cend(), [] (const Math::Vec4f& c) { return c.w > 0.0f; })) {
+				const auto viewportSize = framePool.getFrameDescriptor().calculateSize();
+				Math::Vec2f screenMin(std::numeric_limits<float>::max());
+				Math::Vec2f screenMax(std::numeric_limits<float>::lowest());
+				for(const auto& corner : corners) {
+					const auto position = Math::Vec2f(corner.x, corner.y) / corner.w * viewportSize / 2.0f;
+					screenMin.x = std::min(screenMin.x, position.x);
+					screenMin.y = std::min(screenMin.y, position.y);
+					screenMax.x = std::max(screenMax.x, position.x);
+					screenMax.y = std::max(screenMax.y, position.y);
+				}
+
+				const auto screenSize = screenMax - screenMin;
+				if(screenSize.x < 1.0f && screenSize.y < 1.0f) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
 		void updateProjectionMatrixUniform(const Compositor::Camera& cam) {
 			resources->uniformBuffer.waitCompletion(vulkan);
 
 			const auto size = framePool.getFrameDescriptor().calculateSize();
-			const auto mtx = cam.calculateMatrix(size);
+			projectionMatrix = cam.calculateMatrix(size);
 			resources->uniformBuffer.write(
 				vulkan,
 				RendererBase::DESCRIPTOR_BINDING_PROJECTION_MATRIX,
-				&mtx,
-				sizeof(mtx)
+				&projectionMatrix,
+				sizeof(projectionMatrix)
 			);
 		}
 
@@ -236,6 +1093,426 @@ struct CompositorImpl {
 			);
 		}
 
+		static bool isOutside(	const Math::Mat4x4f& projectionMatrix,
+								const Math::Vec3f& min,
+								const Math::Vec3f& max ) noexcept
+		{
+			//Project the corners of the box
+			std::array<Math::Vec4f, 8> corners;
+			for(size_t i = 0; i < corners.size(); ++i) {
+				corners[i] = projectionMatrix * Math::Vec4f(
+					(i & 0b001) ? max.x : min.x,
+					(i & 0b010) ? max.y : min.y,
+					(i & 0b100) ? max.z : min.z,
+					1.0f
+				);
+			}
+
+			//Check if all corners lay outside the same clip plane
+			const auto allOf = [&corners] (auto predicate) -> bool {
+				return std::all_of(corners.cbegin(), corners.cend(), predicate);
+			};
+
+			return 	allOf([] (const Math::Vec4f& c) { return c.x < -c.w; }) ||
+					allOf([] (const Math::Vec4f& c) { return c.x > +c.w; }) ||
+					allOf([] (const Math::Vec4f& c) { return c.y < -c.w; }) ||
+					allOf([] (const Math::Vec4f& c) { return c.y > +c.w; }) ||
+					allOf([] (const Math::Vec4f& c) { return c.z < 0.0f; }) ||
+					allOf([] (const Math::Vec4f& c) { return c.z > +c.w; }) ;
+		}
+
+		bool calculateScreenBoundaries(	const LayerBvh::Leaf& leaf,
+										Math::Vec2f& min,
+										Math::Vec2f& max,
+										bool& axisAligned ) const
+		{
+			assert(leaf.bounded);
+
+			const auto mvp = projectionMatrix * leaf.modelMatrix;
+			const std::array corners = {
+				mvp * Math::Vec4f(leaf.localMin.x, leaf.localMin.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(leaf.localMax.x, leaf.localMin.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(leaf.localMin.x, leaf.localMax.y, 0.0f, 1.0f),
+				mvp * Math::Vec4f(leaf.localMax.x, leaf.localMax.y, 0.0f, 1.0f)
+			};
+
+			if(!std::all_of(corners.cbegin(), corners.cend(), [] (const Math::Vec4f& c) { return c.w > 0.0f; })) {
+				return false;
+			}
+
+			//Obtain the normalized device coordinates
+			std::array<Math::Vec2f, 4> positions;
+			for(size_t i = 0; i < corners.size(); ++i) {
+				positions[i] = Math::Vec2f(corners[i].x, corners[i].y) / corners[i].w;
+			}
+
+			//Clip the boundaries to the viewport, as the rest is not drawn
+			min = Math::Vec2f(+1.0f);
+			max = Math::Vec2f(-1.0f);
+			for(const auto& position : positions) {
+				min.x = std::min(min.x, position.x);
+				min.y = std::min(min.y, position.y);
+				max.x = std::max(max.x, position.x);
+				max.y = std::max(max.y, position.y);
+			}
+			min.x = std::max(min.x, -1.0f);
+			min.y = std::max(min.y, -1.0f);
+			max.x = std::min(max.x, +1.0f);
+			max.y = std::min(max.y, +1.0f);
+
+			//Check if it is a screen aligned rectangle, so that it fully 
+			//covers its boundaries
+			constexpr auto EPSILON = 1e-5f;
+			axisAligned = 	std::abs(positions[0].y - positions[1].y) < EPSILON &&
+							std::abs(positions[2].y - positions[3].y) < EPSILON &&
+							std::abs(positions[0].x - positions[2].x) < EPSILON &&
+							std::abs(positions[1].x - positions[3].x) < EPSILON ;
+
+			return true;
+		}
+
+		static bool isTransparentNoOp(BlendingMode mode) noexcept {
+			//Modes where a fully transparent (premultiplied zero) source
+			//leaves the destination untouched
+			switch(mode) {
+			case BlendingMode::opacity:
+			case BlendingMode::add:
+			case BlendingMode::differential:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		static bool isOcclusionCandidate(const LayerBase& layer) {
+			//Depth testing on the scene breaks the drawing order. Masks
+			//have side effects, so they are always drawn
+			return 	layer.getRenderingLayer() != RenderingLayer::scene &&
+					!dynamic_cast<const Layers::StencilMask*>(&layer) &&
+					!Layers::StencilMask::isEndLayer(layer) ;
+		}
+
+		static bool isOpaque(const LayerBase& layer) {
+			const auto* videoSurface = dynamic_cast<const Layers::VideoSurface*>(&layer);
+			return videoSurface && videoSurface->isOpaque();
+		}
+
+		static bool isInside(	const LayerBase& layer,
+								Math::Vec2f min,
+								Math::Vec2f max,
+								Math::Vec2f point )
+		{
+			if(	point.x < min.x || point.x > max.x ||
+				point.y < min.y || point.y > max.y )
+			{
+				return false;
+			}
+
+			//Use the exact test for shaped layers
+			if(const auto* bezierCrop = dynamic_cast<const Layers::BezierCrop*>(&layer)) {
+				return bezierCrop->isInside(point);
+			}
+
+			return true;
+		}
+
+		static bool getBoundaries(	const LayerBase& layer,
+									Math::Vec2f& min,
+									Math::Vec2f& max )
+		{
+			bool result = false;
+
+			if(const auto* videoSurface = dynamic_cast<const Layers::VideoSurface*>(&layer)) {
+				//Animated surfaces cover the area swept by the animation
+				max = videoSurface->getSize() / 2.0f;
+				min = -max;
+				result = getAnimationBoundaries(videoSurface->getAnimation(), min, max);
+			} else if(const auto* bezierCrop = dynamic_cast<const Layers::BezierCrop*>(&layer)) {
+				//Cached when the shape changes
+				const auto& boundaries = bezierCrop->getBoundaries();
+				min = Math::Vec2f(boundaries.x, boundaries.y);
+				max = Math::Vec2f(boundaries.z, boundaries.w);
+				result = true;
+			}
+
+			return result;
+		}
+
+		static bool getAnimationBoundaries(	Utils::BufferView<const Layers::VideoSurface::Keyframe> animation,
+											Math::Vec2f& min,
+											Math::Vec2f& max )
+		{
+			if(animation.empty()) {
+				return true; //Static. Left untouched
+			}
+
+			const auto halfSize = (max - min) / 2.0f;
+			Math::Vec2f resultMin(std::numeric_limits<float>::max());
+			Math::Vec2f resultMax(std::numeric_limits<float>::lowest());
+
+			//Union of the areas swept between each pair of keyframes. The
+			//easing may overshoot, but the interpolation factor stays within
+			//the convex hull of its control points. Position and scale are 
+			//linear on it, so their extremes are reached on the ends
+			for(size_t i = 0; i < animation.size(); ++i) {
+				const auto& a = animation[i];
+				const auto& b = animation[std::min(i + 1, animation.size() - 1)];
+
+				if(a.position.z != 0.0f || b.position.z != 0.0f) {
+					return false; //Leaves the plane of the layer
+				}
+
+				const auto& easing = a.easing;
+				const std::array factors = {
+					std::min({ 0.0f, easing.y, easing.w }),
+					std::max({ 1.0f, easing.y, easing.w })
+				};
+
+				Math::Vec2f positionMin(std::numeric_limits<float>::max());
+				Math::Vec2f positionMax(std::numeric_limits<float>::lowest());
+				Math::Vec2f scale(0.0f);
+				for(const auto f : factors) {
+					const auto position = a.position + (b.position - a.position) * f;
+					positionMin.x = std::min(positionMin.x, position.x);
+					positionMin.y = std::min(positionMin.y, position.y);
+					positionMax.x = std::max(positionMax.x, position.x);
+					positionMax.y = std::max(positionMax.y, position.y);
+
+					const auto s = a.scale + (b.scale - a.scale) * f;
+					scale.x = std::max(scale.x, std::abs(s.x));
+					scale.y = std::max(scale.y, std::abs(s.y));
+				}
+
+				//Extent of the scaled and rotated surface around its position.
+				//When rotating, use the circle containing it
+				const auto scaledHalfSize = halfSize * scale;
+				Math::Vec2f extent;
+				if(a.rotation == b.rotation) {
+					const auto c = std::abs(std::cos(a.rotation));
+					const auto s = std::abs(std::sin(a.rotation));
+					extent = Math::Vec2f(
+						c*scaledHalfSize.x + s*scaledHalfSize.y,
+						s*scaledHalfSize.x + c*scaledHalfSize.y
+					);
+				} else {
+					extent = Math::Vec2f(std::hypot(scaledHalfSize.x, scaledHalfSize.y));
+				}
+
+				resultMin.x = std::min(resultMin.x, positionMin.x - extent.x);
+				resultMin.y = std::min(resultMin.y, positionMin.y - extent.y);
+				resultMax.x = std::max(resultMax.x, positionMax.x + extent.x);
+				resultMax.y = std::max(resultMax.y, positionMax.y + extent.y);
+			}
+
+			min = resultMin;
+			max = resultMax;
+			return true;
+		}
+
+		static bool getCurrentBoundaries(	const LayerBase& layer,
+											Math::Mat4x4f& modelMatrix,
+											Math::Vec2f& min,
+											Math::Vec2f& max )
+		{
+			bool result = false;
+
+			if(const auto* videoSurface = dynamic_cast<const Layers::VideoSurface*>(&layer)) {
+				//Evaluate the animation at this moment
+				modelMatrix = modelMatrix * videoSurface->calculateAnimationMatrix();
+				max = videoSurface->getSize() / 2.0f;
+				min = -max;
+				result = true;
+			}
+
+			return result;
+		}
+
+		static vk::PipelineLayout createUpscalePipelineLayout(	const Graphics::Vulkan& vulkan,
+																vk::DescriptorSetLayout frameDescriptorSetLayout ) 
+		{
+			static std::unordered_map<vk::DescriptorSetLayout, const Utils::StaticId> ids;
+			static std::mutex idMutex;
+
+			//Elements are not moved on insertion, so the reference remains
+			//valid once the lock is released
+			std::unique_lock<std::mutex> lock(idMutex);
+			const auto& id = ids[frameDescriptorSetLayout];
+			lock.unlock();
+
+			auto result = vulkan.createPipelineLayout(id);
+			if(!result) {
+				const std::array layouts = {
+					frameDescriptorSetLayout
+				};
+
+				const vk::PipelineLayoutCreateInfo createInfo(
+					{},													//Flags
+					layouts.size(), layouts.data(),						//Descriptor set layouts
+					0, nullptr											//Push constants
+				);
+
+				result = vulkan.createPipelineLayout(id, createInfo);
+			}
+
+			return result;
+		}
+
+		static vk::Pipeline createUpscalePipeline(	const Graphics::Vulkan& vulkan,
+													vk::PipelineLayout layout,
+													vk::RenderPass renderPass,
+													uint32_t sampleMode )
+		{
+			using Index = std::tuple<vk::PipelineLayout, vk::RenderPass, uint32_t>;
+			static std::unordered_map<Index, const Utils::StaticId, Utils::Hasher<Index>> ids;
+			static std::mutex idMutex;
+
+			//Obtain the id related to the configuration
+			Index index(layout, renderPass, sampleMode);
+			std::unique_lock<std::mutex> lock(idMutex);
+			const auto& id = ids[index];
+			lock.unlock();
+
+			//Try to obtain it from cache
+			auto result = vulkan.createGraphicsPipeline(id);
+			if(!result) {
+				//No luck, we need to create it
+				static //So that its ptr can be used as an identifier
+				#include <compositor_upscale_vert.h>
+				const size_t vertId = reinterpret_cast<uintptr_t>(compositor_upscale_vert);
+				static
+				#include <compositor_upscale_frag.h>
+				const size_t fragId = reinterpret_cast<uintptr_t>(compositor_upscale_frag);
+
+				//Try to retrive modules from cache
+				auto vertexShader = vulkan.createShaderModule(vertId);
+				if(!vertexShader) {
+					//Modules isn't in cache. Create it
+					vertexShader = vulkan.createShaderModule(vertId, compositor_upscale_vert);
+				}
+
+				auto fragmentShader = vulkan.createShaderModule(fragId);
+				if(!fragmentShader) {
+					//Modules isn't in cache. Create it
+					fragmentShader = vulkan.createShaderModule(fragId, compositor_upscale_frag);
+				}
+
+				assert(vertexShader);
+				assert(fragmentShader);
+
+				//Specialization info
+				constexpr std::array<vk::SpecializationMapEntry, 1> fragmentShaderSpecializationMap = {
+					vk::SpecializationMapEntry(
+						0,
+						0,
+						sizeof(sampleMode)
+					),
+				};
+
+				const vk::SpecializationInfo fragmentShaderSpecializationInfo(
+					fragmentShaderSpecializationMap.size(), fragmentShaderSpecializationMap.data(),
+					sizeof(sampleMode), &sampleMode
+				);
+
+				constexpr auto SHADER_ENTRY_POINT = "main";
+				const std::array shaderStages = {
+					vk::PipelineShaderStageCreateInfo(		
+						{},												//Flags
+						vk::ShaderStageFlagBits::eVertex,				//Shader type
+						vertexShader,									//Shader handle
+						SHADER_ENTRY_POINT,								//Shader entry point
+						nullptr 										//Specialization
+					),
+					vk::PipelineShaderStageCreateInfo(		
+						{},												//Flags
+						vk::ShaderStageFlagBits::eFragment,				//Shader type
+						fragmentShader,									//Shader handle
+						SHADER_ENTRY_POINT,								//Shader entry point
+						&fragmentShaderSpecializationInfo				//Specialization
+					),
+				};
+
+				//Vertices are generated on the shader
+				constexpr vk::PipelineVertexInputStateCreateInfo vertexInput;
+
+				constexpr vk::PipelineInputAssemblyStateCreateInfo inputAssembly(
+					{},													//Flags
+					vk::PrimitiveTopology::eTriangleStrip,				//Topology
+					false												//Restart enable
+				);
+
+				constexpr vk::PipelineViewportStateCreateInfo viewport(
+					{},													//Flags
+					1, nullptr,											//Viewports (dynamic)
+					1, nullptr											//Scissors (dynamic)
+				);
+
+				constexpr vk::PipelineRasterizationStateCreateInfo rasterizer(
+					{},													//Flags
+					false, 												//Depth clamp enabled
+					false,												//Rasterizer discard enable
+					vk::PolygonMode::eFill,								//Polygon mode
+					vk::CullModeFlagBits::eNone, 						//Cull faces
+					vk::FrontFace::eClockwise,							//Front face direction
+					false, 0.0f, 0.0f, 0.0f,							//Depth bias
+					1.0f												//Line width
+				);
+
+				constexpr vk::PipelineMultisampleStateCreateInfo multisample(
+					{},													//Flags
+					vk::SampleCountFlagBits::e1,						//Sample count
+					false, 1.0f,										//Sample shading enable, min sample shading
+					nullptr,											//Sample mask
+					false, false										//Alpha to coverage, alpha to 1 enable
+				);
+
+				//Neither depth nor stencil is used
+				constexpr vk::PipelineDepthStencilStateCreateInfo depthStencil;
+
+				const std::array colorBlendAttachments = {
+					Graphics::getBlendingConfiguration(BlendingMode::write)
+				};
+
+				const vk::PipelineColorBlendStateCreateInfo colorBlend(
+					{},													//Flags
+					false,												//Enable logic operation
+					vk::LogicOp::eCopy,									//Logic operation
+					colorBlendAttachments.size(), colorBlendAttachments.data() //Blend attachments
+				);
+
+				constexpr std::array dynamicStates = {
+					vk::DynamicState::eViewport,
+					vk::DynamicState::eScissor
+				};
+
+				const vk::PipelineDynamicStateCreateInfo dynamicState(
+					{},													//Flags
+					dynamicStates.size(), dynamicStates.data()			//Dynamic states
+				);
+
+				const vk::GraphicsPipelineCreateInfo createInfo(
+					{},													//Flags
+					shaderStages.size(), shaderStages.data(),			//Shader stages
+					&vertexInput,										//Vertex input
+					&inputAssembly,										//Vertex assembly
+					nullptr,											//Tesselation
+					&viewport,											//Viewports
+					&rasterizer,										//Rasterizer
+					&multisample,										//Multisampling
+					&depthStencil,										//Depth / Stencil tests
+					&colorBlend,										//Color blending
+					&dynamicState,										//Dynamic states
+					layout,												//Pipeline layout
+					renderPass, 0,										//Renderpasses
+					nullptr, 0											//Inherit
+				);
+
+				result = vulkan.createGraphicsPipeline(id, createInfo);
+			}
+
+			assert(result);
+			return result;
+		}
+
 		static Graphics::CommandBufferPool createCommandBufferPool(const Graphics::Vulkan& vulkan) {
 			constexpr vk::CommandPoolCreateFlags flags =
 				vk::CommandPoolCreateFlagBits::eResetCommandBuffer |	//Command buffers will be reset individually
@@ -250,7 +1527,90 @@ struct CompositorImpl {
 		}
 	};
 
+	class TransactionQueue {
+	public:
+		TransactionQueue() 
+			: head(&stub)
+			, tail(&stub)
+			, stub()
+		{
+		}
+
+		TransactionQueue(const TransactionQueue& other) = delete;
+
+		~TransactionQueue() {
+			Compositor::Transaction transaction;
+			while(pop(transaction));
+		}
+
+		TransactionQueue& operator=(const TransactionQueue& other) = delete;
+
+		//Wait-free, may be called from any thread
+		void push(Compositor::Transaction transaction) {
+			push(new Node(std::move(transaction)));
+		}
+
+		//Only to be called from the consumer thread
+		bool pop(Compositor::Transaction& transaction) {
+			auto* node = tail;
+			auto* next = node->next.load(std::memory_order_acquire);
+
+			//Skip the stub
+			if(node == &stub) {
+				if(!next) {
+					return false; //Empty
+				}
+
+				tail = next;
+				node = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+
+			if(!next) {
+				if(node != head.load(std::memory_order_acquire)) {
+					return false; //A producer is in the middle of a push. Retry later
+				}
+
+				//Re-insert the stub so that the last node can be released
+				push(&stub);
+				next = node->next.load(std::memory_order_acquire);
+				if(!next) {
+					return false;
+				}
+			}
+
+			tail = next;
+			transaction = std::move(node->transaction);
+			delete node;
+			return true;
+		}
+
+	private:
+		struct Node {
+			Node(Compositor::Transaction transaction = {})
+				: next(nullptr)
+				, transaction(std::move(transaction))
+			{
+			}
+
+			std::atomic<Node*>							next;
+			Compositor::Transaction						transaction;
+		};
+
+		std::atomic<Node*>								head;
+		Node*											tail;
+		Node											stub;
+
+		void push(Node* node) noexcept {
+			node->next.store(nullptr, std::memory_order_relaxed);
+			auto* prev = head.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+	};
+
 	using Output = Signal::Output<Video>;
+	using LayerList = std::list<std::pair<Compositor::LayerHandle, Compositor::LayerRef>>;
 
 	std::reference_wrapper<Compositor> 			owner;
 
@@ -259,9 +1619,33 @@ struct CompositorImpl {
 	std::unique_ptr<Open>						opened;
 	bool										hasChanged;
 
+	LayerList									layerList;
+	std::unordered_map<Compositor::LayerHandle, LayerList::iterator> layerHandles;
+	Compositor::LayerHandle						lastLayerHandle;
+	std::vector<Compositor::LayerRef>			layerRefs;
+	bool										layersDirty;
+
+	Compositor::Transaction						pendingTransaction;
+	TransactionQueue							transactionQueue;
+
+	Duration									frameTimeBudget;
+
+	bool										automaticFormat;
+	Compositor::FormatRecommendation			formatRecommendation;
+
 	CompositorImpl(	Compositor& comp )
 		: owner(comp)
 		, videoOut(comp, std::string(Signal::makeOutputName<Video>()), createPullCallback(this))
+		, layerList()
+		, layerHandles()
+		, lastLayerHandle(Compositor::NO_LAYER)
+		, layerRefs()
+		, layersDirty(false)
+		, pendingTransaction()
+		, transactionQueue()
+		, frameTimeBudget()
+		, automaticFormat(false)
+		, formatRecommendation{ ColorFormat::R16fG16fB16fA16f, ColorTransferFunction::linear, {} }
 	{
 	}
 
@@ -291,6 +1675,7 @@ struct CompositorImpl {
 
 			//Write changes after locking back
 			opened = std::move(newOpened);
+			opened->setFrameTimeBudget(frameTimeBudget);
 			compositor.setViewportSize(opened->framePool.getFrameDescriptor().calculateSize());
 			compositor.setRenderPass(opened->framePool.getRenderPass().get());
 		}
@@ -308,6 +1693,11 @@ struct CompositorImpl {
 		auto& compositor = static_cast<Compositor&>(base);
 		assert(&owner.get() == &compositor);
 		
+		//Pending layer changes would not reach a frame anymore
+		if(layersDirty) {
+			publishLayers();
+		}
+
 		//Write changes
 		videoOut.reset();
 		compositor.setViewportSize(Math::Vec2f());
@@ -333,20 +1723,61 @@ struct CompositorImpl {
 	void update() {
 		auto& compositor = owner.get();
 
+		//Gather the changes posted from other threads
+		Compositor::Transaction transaction;
+		while(transactionQueue.pop(transaction)) {
+			pendingTransaction.merge(std::move(transaction));
+			transaction.clear();
+		}
+
+		//Apply all the changes at the frame boundary
+		apply(pendingTransaction);
+		pendingTransaction.clear();
+		bool inputsChanged = layersDirty;
+		if(layersDirty) {
+			publishLayers();
+		}
+
 		if(opened) {
-			if(hasChanged || compositor.layersHaveChanged()) {
+			opened->updateVisibility(compositor);
+			if(hasChanged || opened->layersHaveChanged(compositor)) {
 				videoOut.push(opened->draw(compositor));
 
 				//Update the state
 				hasChanged = false;
+				inputsChanged = true;
 			}
 		}
+
+		//Input formats can only change along with the layers. Renegotiate 
+		//once the frame has been drawn, so that the new format applies
+		//from the next frame on
+		if(automaticFormat && inputsChanged) {
+			updateFormatRecommendation();
+		}
 	}
 
 	std::vector<VideoMode> getVideoModeCompatibility() const {
 		const auto& compositor = owner.get();
 		std::vector<VideoMode> result;
 
+		if(automaticFormat) {
+			//Only offer the recommended format
+			result.emplace_back(
+				Utils::MustBe<Rate>(Rate(0, 1)),
+				compositor.getInstance().getResolutionSupport(),
+				Utils::Any<AspectRatio>(),
+				Utils::Any<ColorPrimaries>(),
+				Utils::MustBe<ColorModel>(ColorModel::rgb),
+				Utils::MustBe<ColorTransferFunction>(formatRecommendation.colorTransferFunction),
+				Utils::MustBe<ColorSubsampling>(ColorSubsampling::rb444),
+				Utils::MustBe<ColorRange>(ColorRange::full),
+				Utils::MustBe<ColorFormat>(formatRecommendation.format)
+			);
+
+			return result;
+		}
+
 		//Normal formats
 		result.emplace_back(
 			Utils::MustBe<Rate>(Rate(0, 1)),
@@ -406,6 +1837,7 @@ struct CompositorImpl {
 					depthStencilFormat,
 					compositor.getCamera()
 				);
+				opened->setFrameTimeBudget(frameTimeBudget);
 			}
 
 			//Update the size and the renderpass
@@ -426,6 +1858,139 @@ struct CompositorImpl {
 		recreateCallback(compositor, compositor.getVideoMode(), depthStencilFormat);
 	}
 
+	Compositor::LayerHandle insertLayer(LayerBase& layer, Compositor::LayerHandle before) {
+		syncLayers();
+
+		const auto position = findLayer(before);
+		const auto handle = ++lastLayerHandle;
+		assert(handle != Compositor::NO_LAYER);
+
+		const auto ite = layerList.emplace(position, handle, layer);
+		layerHandles.emplace(handle, ite);
+		invalidateLayers();
+
+		return handle;
+	}
+
+	void removeLayer(Compositor::LayerHandle handle) {
+		syncLayers();
+
+		const auto ite = layerHandles.find(handle);
+		assert(ite != layerHandles.cend());
+		if(ite != layerHandles.cend()) {
+			layerList.erase(ite->second);
+			layerHandles.erase(ite);
+			invalidateLayers();
+		}
+	}
+
+	void moveLayer(Compositor::LayerHandle handle, Compositor::LayerHandle before) {
+		syncLayers();
+
+		const auto ite = layerHandles.find(handle);
+		assert(ite != layerHandles.cend());
+		if(ite != layerHandles.cend() && handle != before) {
+			//Splicing does not invalidate the iterators
+			layerList.splice(findLayer(before), layerList, ite->second);
+			invalidateLayers();
+		}
+	}
+
+	void commit(Compositor::Transaction transaction) {
+		if(owner.get().isOpen()) {
+			//Defer it until the next frame
+			pendingTransaction.merge(std::move(transaction));
+		} else {
+			//No frames will be rendered, apply it right away
+			apply(transaction);
+		}
+	}
+
+	void post(Compositor::Transaction transaction) {
+		transactionQueue.push(std::move(transaction));
+	}
+
+	LayerBase* pick(Math::Vec2f position) {
+		return opened ? opened->pick(owner.get(), position) : nullptr;
+	}
+
+	LayerBase* getLayer(Compositor::LayerHandle handle) const {
+		const auto ite = layerHandles.find(handle);
+		return (ite != layerHandles.cend()) ? &(ite->second->second.get()) : nullptr;
+	}
+
+	void setFrameTimeBudget(Duration budget) {
+		frameTimeBudget = budget;
+
+		if(opened) {
+			opened->setFrameTimeBudget(frameTimeBudget);
+		}
+	}
+
+	Duration getFrameTimeBudget() const {
+		return frameTimeBudget;
+	}
+
+	Compositor::GovernorStatistics getGovernorStatistics() const {
+		return opened ? opened->getGovernorStatistics() : Compositor::GovernorStatistics{ 1.0f, false, Duration(), 0, 0 };
+	}
+
+	ScalingFilter limitScalingFilter(ScalingFilter filter) const noexcept {
+		const bool reduce = opened && opened->isFilteringReduced();
+		return (reduce && filter == ScalingFilter::cubic) ? ScalingFilter::linear : filter;
+	}
+
+	void setAutomaticFormat(bool ena) {
+		if(automaticFormat != ena) {
+			automaticFormat = ena;
+			formatRecommendation = getFormatRecommendation();
+
+			auto& compositor = owner.get();
+			compositor.setVideoModeCompatibility(getVideoModeCompatibility());
+		}
+	}
+
+	bool getAutomaticFormat() const {
+		return automaticFormat;
+	}
+
+	Compositor::FormatRecommendation getFormatRecommendation() const {
+		const auto& compositor = owner.get();
+		const auto& vulkan = compositor.getInstance().getVulkan();
+
+		//Obtain the most demanding input
+		auto precision = InputPrecision::none;
+		for(const auto& layer : compositor.getLayers()) {
+			precision = std::max(precision, getInputPrecision(layer.get()));
+		}
+
+		//Use the cheapest supported format that is adequate for it. 
+		//Blending happens in linear light, so 10 bit integer targets 
+		//would band worse than 8 bit sRGB. Deep inputs need half floats
+		const auto srgbFormats = Graphics::TargetFrame::getSupportedSrgbFormats(vulkan);
+		const auto isSupported = [] (const std::vector<ColorFormat>& supported, ColorFormat format) -> bool {
+			return std::find(supported.cbegin(), supported.cend(), format) != supported.cend();
+		};
+
+		if(precision <= InputPrecision::standard && isSupported(srgbFormats, ColorFormat::R8G8B8A8)) {
+			return Compositor::FormatRecommendation {
+				ColorFormat::R8G8B8A8,
+				ColorTransferFunction::iec61966_2_1,
+				precision == InputPrecision::none 	? "No frame inputs. 8 bit sRGB is enough"
+													: "All inputs are 8 bit SDR. Hardware sRGB encoding keeps precision"
+			};
+		} else {
+			return Compositor::FormatRecommendation {
+				ColorFormat::R16fG16fB16fA16f,
+				ColorTransferFunction::linear,
+				precision == InputPrecision::high	? "Inputs are HDR or linear" :
+				precision == InputPrecision::deep	? "Inputs have more than 8 bits per component"
+													: "8 bit sRGB targets are not supported"
+			};
+		}
+	}
+
+
 	void cameraCallback(RendererBase& base, const Compositor::Camera& cam) {
 		auto& compositor = static_cast<Compositor&>(base);
 		assert(&owner.get() == &compositor); (void)compositor;
@@ -433,9 +1998,168 @@ struct CompositorImpl {
 		if(opened) {
 			opened->setCamera(cam);
 		}
+
+		hasChanged = true; //Visibility of the layers may have changed
 	}
 
 private:
+	enum class InputPrecision {
+		none,		//No frames
+		standard,	//8 bit SDR
+		deep,		//10 or 12 bit SDR
+		high,		//HDR or linear
+	};
+
+	void updateFormatRecommendation() {
+		const auto recommendation = getFormatRecommendation();
+		if(	recommendation.format != formatRecommendation.format ||
+			recommendation.colorTransferFunction != formatRecommendation.colorTransferFunction )
+		{
+			formatRecommendation = recommendation;
+
+			auto& compositor = owner.get();
+			compositor.setVideoModeCompatibility(getVideoModeCompatibility());
+		}
+	}
+
+	static InputPrecision getInputPrecision(const LayerBase& layer) {
+		const Video* frame = nullptr;
+		if(const auto* videoSurface = dynamic_cast<const Layers::VideoSurface*>(&layer)) {
+			frame = &videoSurface->getLastFrame();
+		} else if(const auto* bezierCrop = dynamic_cast<const Layers::BezierCrop*>(&layer)) {
+			frame = &bezierCrop->getLastFrame();
+		}
+
+		if(!frame || !(*frame) || !(*frame)->getDescriptor()) {
+			return InputPrecision::none;
+		}
+
+		//The transfer function tells the signal range, whilst the format
+		//tells the precision of the samples
+		const auto& descriptor = *((*frame)->getDescriptor());
+		switch(descriptor.getColorTransferFunction()) {
+		case ColorTransferFunction::linear:
+		case ColorTransferFunction::smpte2084:
+		case ColorTransferFunction::arib_std_b67:
+			return InputPrecision::high;
+
+		default:
+			return 	(getComponentBitDepth(descriptor.getColorFormat()) > 8) ?
+					InputPrecision::deep :
+					InputPrecision::standard ;
+		}
+	}
+
+	static uint32_t getComponentBitDepth(ColorFormat format) {
+		//Widest component of the format. The rest have 8 bits or less
+		switch(format) {
+		case ColorFormat::A2R10G10B10:
+		case ColorFormat::A2B10G10R10:
+		case ColorFormat::G10X6_B10X6R10X6:
+			return 10;
+
+		case ColorFormat::R16G16B16A16:
+		case ColorFormat::R16fG16fB16fA16f:
+			return 16;
+
+		case ColorFormat::R32fG32fB32fA32f:
+			return 32;
+
+		default:
+			return 8;
+		}
+	}
+
+	static void apply(const Compositor::Transaction& transaction) {
+		for(const auto& change : transaction.changes) {
+			auto& layer = *change.first;
+			const auto& changes = change.second;
+
+			if(changes.transform) {
+				layer.setTransform(*changes.transform);
+			}
+
+			if(changes.opacity) {
+				layer.setOpacity(*changes.opacity);
+			}
+
+			if(changes.size) {
+				assert(changes.sizeSetter);
+				changes.sizeSetter(layer, *changes.size);
+			}
+		}
+	}
+
+	LayerList::iterator findLayer(Compositor::LayerHandle handle) {
+		//No layer means the end of the list, on top of the rest
+		const auto ite = layerHandles.find(handle);
+		assert(handle == Compositor::NO_LAYER || ite != layerHandles.cend());
+		return (ite != layerHandles.cend()) ? ite->second : layerList.end();
+	}
+
+	void syncLayers() {
+		//Layers set directly with setLayers() win over the edits made
+		//before through the handles, which are discarded
+		if(!isSynchronized()) {
+			adoptLayers();
+		}
+	}
+
+	bool isSynchronized() const {
+		//The renderer keeps the last published list unless the layers
+		//have been set from elsewhere
+		const auto layers = owner.get().getLayers();
+		return std::equal(
+			layers.cbegin(), layers.cend(),
+			layerRefs.cbegin(), layerRefs.cend(),
+			[] (const Compositor::LayerRef& a, const Compositor::LayerRef& b) -> bool {
+				return &a.get() == &b.get();
+			}
+		);
+	}
+
+	void adoptLayers() {
+		//Previous handles are no longer valid
+		const auto layers = owner.get().getLayers();
+		layerList.clear();
+		layerHandles.clear();
+		layerRefs.assign(layers.cbegin(), layers.cend());
+		layersDirty = false;
+
+		for(const auto& layer : layers) {
+			const auto handle = ++lastLayerHandle;
+			const auto ite = layerList.emplace(layerList.cend(), handle, layer);
+			layerHandles.emplace(handle, ite);
+		}
+	}
+
+	void invalidateLayers() {
+		layersDirty = true;
+
+		if(!owner.get().isOpen()) {
+			//No frames will be rendered, publish it right away
+			publishLayers();
+		}
+	}
+
+	void publishLayers() {
+		assert(layersDirty);
+		if(!isSynchronized()) {
+			//setLayers() has been called after the last edit
+			adoptLayers();
+			return;
+		}
+
+		layersDirty = false;
+		layerRefs.clear();
+		layerRefs.reserve(layerList.size());
+		for(const auto& layer : layerList) {
+			layerRefs.push_back(layer.second);
+		}
+
+		owner.get().setLayers(layerRefs);
+	}
+
 	static Output::PullCallback createPullCallback(CompositorImpl* impl) {
 		return [impl] (Output&) {
 			impl->owner.get().update();
@@ -479,4 +2203,129 @@ Compositor::~Compositor() = default;
 
 Compositor& Compositor::operator=(Compositor&& other) = default;
 
+
+Compositor::LayerHandle Compositor::insertLayer(LayerBase& layer, LayerHandle before) {
+	return (*this)->insertLayer(layer, before);
+}
+
+void Compositor::removeLayer(LayerHandle handle) {
+	(*this)->removeLayer(handle);
+}
+
+void Compositor::moveLayer(LayerHandle handle, LayerHandle before) {
+	(*this)->moveLayer(handle, before);
+}
+
+LayerBase* Compositor::getLayer(LayerHandle handle) const {
+	return (*this)->getLayer(handle);
+}
+
+
+LayerBase* Compositor::pick(Math::Vec2f position) {
+	return (*this)->pick(position);
+}
+
+
+void Compositor::commit(Transaction transaction) {
+	(*this)->commit(std::move(transaction));
+}
+
+void Compositor::post(Transaction transaction) {
+	(*this)->post(std::move(transaction));
+}
+
+
+void Compositor::setFrameTimeBudget(Duration budget) {
+	(*this)->setFrameTimeBudget(budget);
+}
+
+Duration Compositor::getFrameTimeBudget() const {
+	return (*this)->getFrameTimeBudget();
+}
+
+Compositor::GovernorStatistics Compositor::getGovernorStatistics() const {
+	return (*this)->getGovernorStatistics();
+}
+
+ScalingFilter Compositor::limitScalingFilter(const RendererBase& renderer, ScalingFilter filter) noexcept {
+	const auto* compositor = dynamic_cast<const Compositor*>(&renderer);
+	return compositor ? (*compositor)->limitScalingFilter(filter) : filter;
+}
+
+
+void Compositor::setAutomaticFormat(bool ena) {
+	(*this)->setAutomaticFormat(ena);
+}
+
+bool Compositor::getAutomaticFormat() const {
+	return (*this)->getAutomaticFormat();
+}
+
+Compositor::FormatRecommendation Compositor::getFormatRecommendation() const {
+	return (*this)->getFormatRecommendation();
+}
+
+
+
+/*
+ * Compositor::Transaction
+ */
+
+void Compositor::Transaction::setTransform(LayerBase& layer, const Math::Transformf& transform) {
+	changes[&layer].transform = transform;
+}
+
+void Compositor::Transaction::setOpacity(LayerBase& layer, float opacity) {
+	changes[&layer].opacity = opacity;
+}
+
+void Compositor::Transaction::setSize(Layers::VideoSurface& layer, Math::Vec2f size) {
+	auto& change = changes[&layer];
+	change.size = size;
+	change.sizeSetter = [] (LayerBase& layer, Math::Vec2f size) {
+		static_cast<Layers::VideoSurface&>(layer).setSize(size);
+	};
+}
+
+void Compositor::Transaction::setSize(Layers::BezierCrop& layer, Math::Vec2f size) {
+	auto& change = changes[&layer];
+	change.size = size;
+	change.sizeSetter = [] (LayerBase& layer, Math::Vec2f size) {
+		static_cast<Layers::BezierCrop&>(layer).setSize(size);
+	};
+}
+
+
+void Compositor::Transaction::merge(Transaction other) {
+	if(changes.empty()) {
+		changes = std::move(other.changes);
+	} else {
+		//Newer changes override the older ones
+		for(auto& change : other.changes) {
+			auto& dst = changes[change.first];
+
+			if(change.second.transform) {
+				dst.transform = std::move(change.second.transform);
+			}
+
+			if(change.second.opacity) {
+				dst.opacity = change.second.opacity;
+			}
+
+			if(change.second.size) {
+				dst.size = change.second.size;
+				dst.sizeSetter = change.second.sizeSetter;
+			}
+		}
+	}
+}
+
+bool Compositor::Transaction::empty() const noexcept {
+	return changes.empty();
+}
+
+void Compositor::Transaction::clear() noexcept {
+	changes.clear();
+}
+
 }